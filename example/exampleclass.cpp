@@ -1,6 +1,5 @@
 #include "exampleclass.h"
 #include <QTimer>
-#include <QEventLoop>
 
 ExampleClass::ExampleClass(QObject *parent) :
     QObject(parent)
@@ -33,11 +32,25 @@ qreal ExampleClass::sum(QList<qreal> list)
     return sum;
 }
 
-void ExampleClass::sleepAndNotify(int msec, QString message)
+void ExampleClass::sleepAndNotify(int msec, QString message, RpcDeferredReply reply)
 {
-    QEventLoop sleepLoop;
-    QTimer::singleShot(msec, &sleepLoop, SLOT(quit()));
-    sleepLoop.exec();
+    // reply when the timer fires instead of blocking the connection meanwhile
+    QTimer *timer = new QTimer(this);
+    timer->setSingleShot(true);
+    connect(timer, SIGNAL(timeout()), SLOT(sleepTimer_timeout()));
+    sleepingNotifications.insert(timer, qMakePair(message, reply));
+    timer->start(msec);
+}
+
+void ExampleClass::sleepTimer_timeout()
+{
+    QTimer *timer = qobject_cast<QTimer *>(sender());
+    if(!sleepingNotifications.contains(timer))
+        return;
+
+    QPair<QString, RpcDeferredReply> notification = sleepingNotifications.take(timer);
+    timer->deleteLater();
 
-    emit notify(message);
+    emit notify(notification.first);
+    notification.second.finish(QVariant());
 }
@@ -2,6 +2,11 @@
 #define EXAMPLECLASS_H
 
 #include <QObject>
+#include <QHash>
+#include <QPair>
+#include <RpcDeferredReply>
+
+class QTimer;
 
 class ExampleClass : public QObject
 {
@@ -17,7 +22,13 @@ public slots:
     QString concat(QString a, QString b);
     int sum(QList<int> list);
     qreal sum(QList<qreal> list);
-    void sleepAndNotify(int msec, QString message);
+    void sleepAndNotify(int msec, QString message, RpcDeferredReply reply);
+
+private slots:
+    void sleepTimer_timeout();
+
+private:
+    QHash<QTimer *, QPair<QString, RpcDeferredReply> > sleepingNotifications;
 };
 
 #endif // EXAMPLECLASS_H
@@ -0,0 +1,98 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#ifndef BENCHMARKCLIENT_H
+#define BENCHMARKCLIENT_H
+
+#include <QObject>
+#include <QCoreApplication>
+#include <QLocalSocket>
+#include <QVariant>
+#include <QtSimpleRpc>
+
+//! Keeps one call at a time outstanding until it has made \arg calls calls
+class BenchmarkClient : public QObject
+{
+    Q_OBJECT
+public:
+    BenchmarkClient(const QString &serverName, int calls, int rounds, QObject *parent = 0) :
+        QObject(parent), remaining(calls), rounds(rounds), errors(0)
+    {
+        socket.connectToServer(serverName);
+        socket.waitForConnected(5000);
+        rpc.setPeerDevice(&socket);
+    }
+
+    bool isConnected() const { return socket.state() == QLocalSocket::ConnectedState; }
+    int errorCount() const { return errors; }
+
+    void start() { callNext(); }
+
+signals:
+    void finished();
+
+private slots:
+    void callFinished(QVariant result, int errorCode)
+    {
+        Q_UNUSED(result);
+        if(errorCode != QtSimpleRpc::NoError)
+            ++errors;
+        if(--remaining > 0)
+            callNext();
+        else
+            emit finished();
+    }
+
+private:
+    QLocalSocket socket;
+    QtSimpleRpc rpc;
+    int remaining;
+    int rounds;
+    int errors;
+
+    void callNext()
+    {
+        rpc.remoteCallWithCallback("work", QVariantList() << qlonglong(rounds), this, SLOT(callFinished(QVariant,int)));
+    }
+};
+
+//! Quits the application once all clients have finished
+class BenchmarkRun : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BenchmarkRun(int clients, QObject *parent = 0) : QObject(parent), running(clients) {}
+
+public slots:
+    void clientFinished()
+    {
+        if(--running == 0)
+            QCoreApplication::quit();
+    }
+
+private:
+    int running;
+};
+
+#endif // BENCHMARKCLIENT_H
@@ -0,0 +1,97 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QElapsedTimer>
+
+#include <iostream>
+using namespace std;
+
+#include "benchmarkservice.h"
+#include "benchmarkclient.h"
+#include <RpcServer>
+
+// Serves many local clients at once and reports the calls answered per
+// second, to compare I/O thread counts. The clients run in the main thread
+// of this process, each keeping one call outstanding.
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    // Parse arguments
+    QStringList args = a.arguments();
+    int clientCount = (args.count() > 1) ? args[1].toInt() : 200;
+    int callsPerClient = (args.count() > 2) ? args[2].toInt() : 100;
+    int ioThreads = (args.count() > 3) ? args[3].toInt() : -1;
+    int rounds = (args.count() > 4) ? args[4].toInt() : 1000;
+    if(args.count() > 5 || clientCount <= 0 || callsPerClient <= 0 || rounds < 0) {
+        cerr << "Usage: " << args[0].toStdString()
+             << " [clients] [calls per client] [I/O threads, -1: one per core] [work rounds per call]" << endl;
+        return 1;
+    }
+
+    // Set up the server
+    BenchmarkService service;
+    RpcServer server;
+    server.setIoThreadCount(ioThreads);
+    server.bindObjectAllSlotsIncoming(&service);
+    QString serverName = QString("qtsimplerpc-serverbenchmark-%1").arg(a.applicationPid());
+    if(!server.listen(serverName)) {
+        cerr << "Can't listen: " << server.errorString().toStdString() << endl;
+        return 1;
+    }
+
+    // Connect all clients before starting any calls
+    BenchmarkRun run(clientCount);
+    QList<BenchmarkClient *> clients;
+    for(int i = 0; i < clientCount; ++i)
+    {
+        BenchmarkClient *client = new BenchmarkClient(serverName, callsPerClient, rounds, &run);
+        if(!client->isConnected()) {
+            cerr << "Can't connect client " << i << endl;
+            return 1;
+        }
+        QObject::connect(client, SIGNAL(finished()), &run, SLOT(clientFinished()));
+        clients << client;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    foreach(BenchmarkClient *client, clients)
+        client->start();
+    a.exec();
+    qint64 msec = qMax<qint64>(timer.elapsed(), 1);
+
+    int errors = 0;
+    foreach(BenchmarkClient *client, clients)
+        errors += client->errorCount();
+    qint64 calls = qint64(clientCount) * callsPerClient;
+    cout << clientCount << " clients, " << server.ioThreadCount() << " I/O threads: "
+         << calls << " calls in " << msec << " ms, " << calls * 1000 / msec << " calls/s, "
+         << errors << " errors" << endl;
+
+    return errors ? 1 : 0;
+}
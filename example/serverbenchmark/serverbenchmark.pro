@@ -0,0 +1,12 @@
+QT -= gui
+QT += network
+
+TEMPLATE = app
+
+LIBS += -L../../qtsimplerpc-build-desktop -lQtSimpleRpc
+INCLUDEPATH += ../../include
+
+HEADERS += benchmarkservice.h \
+    benchmarkclient.h
+
+SOURCES += main.cpp
@@ -0,0 +1,62 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#ifndef BENCHMARKTARGET_H
+#define BENCHMARKTARGET_H
+
+#include <QObject>
+#include <QString>
+#include <RpcSharedBuffer>
+
+class BenchmarkTarget : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BenchmarkTarget(QObject *parent = 0) : QObject(parent) {}
+
+public slots:
+    QString echo(QString data) { return data; }
+
+    int sumBytes(QString data)
+    {
+        QByteArray bytes = data.toLatin1();
+        return sum(bytes.constData(), bytes.size());
+    }
+
+    int sumSharedBytes(RpcSharedBuffer buffer)
+    {
+        return sum(buffer.constData(), buffer.size());
+    }
+
+private:
+    static int sum(const char *data, int size)
+    {
+        int result = 0;
+        for(int i = 0; i < size; ++i)
+            result += (unsigned char) data[i];
+        return result;
+    }
+};
+
+#endif // BENCHMARKTARGET_H
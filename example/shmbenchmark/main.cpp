@@ -0,0 +1,158 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QElapsedTimer>
+#include <string.h>
+
+#include <iostream>
+using namespace std;
+
+#include "benchmarktarget.h"
+#include <QtSimpleRpc>
+#include <RpcSharedMemoryDevice>
+#include <RpcSharedBuffer>
+
+// Compares calls through a QLocalSocket with calls through an
+// RpcSharedMemoryDevice on top of the same socket. Both peers live in this
+// process; the caller's blocking remoteCall() runs the event loop which
+// serves the other peer.
+
+static bool connectSockets(QLocalServer *server, QLocalSocket *client, QLocalSocket **serverSide)
+{
+    QString name = QString("qtsimplerpc-shmbenchmark-%1").arg(QCoreApplication::applicationPid());
+    QLocalServer::removeServer(name);
+    if(!server->listen(name))
+        return false;
+    client->connectToServer(name);
+    if(!client->waitForConnected(5000) || !server->waitForNewConnection(5000))
+        return false;
+    *serverSide = server->nextPendingConnection();
+    return *serverSide != 0;
+}
+
+static void runCalls(const char *transport, QtSimpleRpc *rpc, int payloadSize, int calls)
+{
+    QVariantList arguments;
+    arguments << QString(payloadSize, QChar('x'));
+
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < calls; ++i)
+        rpc->remoteCall("echo", arguments);
+    qint64 msec = qMax<qint64>(timer.elapsed(), 1);
+
+    cout << transport << "\techo " << payloadSize << " bytes\t"
+         << calls * 1000 / msec << " calls/s\t"
+         << double(payloadSize) * calls * 2 / 1024 / 1024 * 1000 / msec << " MiB/s" << endl;
+}
+
+static void runLargeArgument(const char *transport, QtSimpleRpc *rpc, int size, int calls, bool shared)
+{
+    RpcSharedBuffer buffer;
+    QVariantList arguments;
+    if(shared) {
+        buffer = RpcSharedBuffer::create(size);
+        memset(buffer.data(), 'x', size);
+        arguments << buffer.reference();
+    } else {
+        arguments << QString(size, QChar('x'));
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < calls; ++i)
+        rpc->remoteCall(shared ? "sumSharedBytes" : "sumBytes", arguments);
+    qint64 msec = qMax<qint64>(timer.elapsed(), 1);
+
+    cout << transport << "\t" << (shared ? "shared " : "copied ") << size << " bytes\t"
+         << calls * 1000 / msec << " calls/s" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    int calls = (a.arguments().count() > 1) ? a.arguments()[1].toInt() : 2000;
+    if(calls <= 0) {
+        cerr << "Usage: " << a.arguments()[0].toStdString() << " [calls]" << endl;
+        return 1;
+    }
+
+    BenchmarkTarget target;
+    QList<int> payloadSizes = QList<int>() << 16 << 1024 << 64 * 1024;
+
+    // Plain local socket
+    {
+        QLocalServer server;
+        QLocalSocket client;
+        QLocalSocket *serverSide;
+        if(!connectSockets(&server, &client, &serverSide)) {
+            cerr << "Can't connect local sockets" << endl;
+            return 1;
+        }
+
+        QtSimpleRpc caller, callee;
+        caller.setPeerDevice(&client);
+        callee.setPeerDevice(serverSide);
+        callee.bindObjectAllSlotsIncoming(&target);
+
+        foreach(int size, payloadSizes)
+            runCalls("socket", &caller, size, calls);
+        runLargeArgument("socket", &caller, 16 * 1024 * 1024, calls / 100 + 1, false);
+    }
+
+    // Shared memory, with the local socket as the doorbell only
+    {
+        QLocalServer server;
+        QLocalSocket client;
+        QLocalSocket *serverSide;
+        if(!connectSockets(&server, &client, &serverSide)) {
+            cerr << "Can't connect local sockets" << endl;
+            return 1;
+        }
+
+        RpcSharedMemoryDevice callerDevice, calleeDevice;
+        if(!callerDevice.create(&client)) {
+            cerr << "Can't create shared memory: " << callerDevice.errorString().toStdString() << endl;
+            return 1;
+        }
+        calleeDevice.attach(serverSide);
+
+        QtSimpleRpc caller, callee;
+        caller.setPeerDevice(&callerDevice);
+        callee.setPeerDevice(&calleeDevice);
+        callee.bindObjectAllSlotsIncoming(&target);
+
+        foreach(int size, payloadSizes)
+            runCalls("shm", &caller, size, calls);
+        runLargeArgument("shm", &caller, 16 * 1024 * 1024, calls / 100 + 1, false);
+        runLargeArgument("shm", &caller, 16 * 1024 * 1024, calls / 100 + 1, true);
+    }
+
+    return 0;
+}
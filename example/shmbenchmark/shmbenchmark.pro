@@ -0,0 +1,11 @@
+QT -= gui
+QT += network
+
+TEMPLATE = app
+
+LIBS += -L../../qtsimplerpc-build-desktop -lQtSimpleRpc
+INCLUDEPATH += ../../include
+
+HEADERS += benchmarktarget.h
+
+SOURCES += main.cpp
@@ -0,0 +1 @@
+../qtsimplerpc/rpcdeferredreply.h
\ No newline at end of file
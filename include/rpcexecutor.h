@@ -0,0 +1 @@
+../qtsimplerpc/rpcexecutor.h
\ No newline at end of file
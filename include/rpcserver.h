@@ -0,0 +1 @@
+../qtsimplerpc/rpcserver.h
\ No newline at end of file
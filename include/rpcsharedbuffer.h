@@ -0,0 +1 @@
+../qtsimplerpc/rpcsharedbuffer.h
\ No newline at end of file
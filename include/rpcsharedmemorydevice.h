@@ -0,0 +1 @@
+../qtsimplerpc/rpcsharedmemorydevice.h
\ No newline at end of file
@@ -0,0 +1 @@
+../qtsimplerpc/rpcstreamwriter.h
\ No newline at end of file
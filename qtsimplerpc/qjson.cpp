@@ -235,6 +235,11 @@ void QJson::treatMetaTypeAsInteger(int metaType)
     metaTypes_int << metaType;
 }
 
+bool QJson::isMetaTypeTreatedAsInteger(int metaType)
+{
+    return metaTypes_int.contains(metaType);
+}
+
 template<typename QVariantHashOrMap>
 QString QJson::serializeObject(QVariantHashOrMap container, EncodeOptions options, Error *error, int indentation, const QString &optionalNewLine, const QString &optionalIndentedNewLine, const QString &indentedLinePrefix)
 {
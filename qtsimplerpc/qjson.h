@@ -85,6 +85,7 @@ public:
 
     //! Use this method to treat the given type, for example an enumerator, as it would be an integer. This may lead to program crash if the type can't be treated as an integer.
     static void treatMetaTypeAsInteger(int metaType);
+    static bool isMetaTypeTreatedAsInteger(int metaType);
 
 private:
     QJson();
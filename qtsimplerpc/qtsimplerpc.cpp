@@ -6,6 +6,8 @@ QtSimpleRpc::QtSimpleRpc(QObject *parent) :
     QObject(parent),
     connection(new RpcConnection(this))
 {
+    connect(connection, SIGNAL(congested()), SIGNAL(congested()));
+    connect(connection, SIGNAL(drained()), SIGNAL(drained()));
 }
 
 void QtSimpleRpc::registerEnumsOfMetaObject(const QMetaObject *metaObject)
@@ -23,6 +25,102 @@ QIODevice *QtSimpleRpc::peerDevice() const
     return connection->peerDevice();
 }
 
+void QtSimpleRpc::setBinaryFramingEnabled(bool enabled)
+{
+    connection->setFramingMode(enabled ? RpcConnection::BinaryFraming : RpcConnection::LineFraming);
+}
+
+bool QtSimpleRpc::isBinaryFramingEnabled() const
+{
+    return connection->framingMode() == RpcConnection::BinaryFraming;
+}
+
+void QtSimpleRpc::setCodec(const QByteArray &codecName)
+{
+    connection->setCodec(codecName);
+}
+
+QByteArray QtSimpleRpc::codec() const
+{
+    return connection->codec();
+}
+
+void QtSimpleRpc::setCompression(const QByteArray &compressorName, int threshold)
+{
+    connection->setCompression(compressorName, threshold);
+}
+
+QByteArray QtSimpleRpc::compression() const
+{
+    return connection->compression();
+}
+
+void QtSimpleRpc::setBinaryFramingAccepted(bool accepted)
+{
+    connection->setBinaryFramingAccepted(accepted);
+}
+
+void QtSimpleRpc::setCodecAccepted(const QByteArray &codecName, bool accepted)
+{
+    connection->setCodecAccepted(codecName, accepted);
+}
+
+void QtSimpleRpc::setCompressionAccepted(const QByteArray &compressorName, bool accepted)
+{
+    connection->setCompressionAccepted(compressorName, accepted);
+}
+
+void QtSimpleRpc::setMaximumMessageSize(int bytes)
+{
+    connection->setMaximumMessageSize(bytes);
+}
+
+void QtSimpleRpc::setWriteCoalescing(int msec, int thresholdBytes)
+{
+    connection->setWriteCoalescingDelay(msec);
+    connection->setWriteBufferThreshold(thresholdBytes);
+}
+
+void QtSimpleRpc::flushNow()
+{
+    connection->flushNow();
+}
+
+void QtSimpleRpc::setWriteWatermarks(int high, int low)
+{
+    connection->setWriteWatermarks(high, low);
+}
+
+void QtSimpleRpc::setSignalCongestionPolicy(SignalCongestionPolicy policy)
+{
+    connection->setSignalCongestionPolicy(static_cast<RpcConnection::SignalCongestionPolicy>(policy));
+}
+
+void QtSimpleRpc::setSignalBatchWindow(int msec)
+{
+    connection->setSignalBatchWindow(msec);
+}
+
+void QtSimpleRpc::setSignalSubscriptionEnabled(bool enabled)
+{
+    connection->setSignalSubscriptionEnabled(enabled);
+}
+
+void QtSimpleRpc::subscribeCommand(QByteArray commandName)
+{
+    connection->subscribeCommand(commandName);
+}
+
+void QtSimpleRpc::unsubscribeCommand(QByteArray commandName)
+{
+    connection->unsubscribeCommand(commandName);
+}
+
+bool QtSimpleRpc::isCongested() const
+{
+    return connection->isCongested();
+}
+
 void QtSimpleRpc::bindObjectAllMembers(QObject *object)
 {
     connection->mapAllCommandsToSlots(object);
@@ -39,9 +137,11 @@ void QtSimpleRpc::bindObjectAllSignalsOutgoing(QObject *object)
     connection->mapAllSignalsToCommands(object);
 }
 
-void QtSimpleRpc::bindSlotAsCustomIncomingCommand(QObject *object, const char *member, QByteArray commandName)
+void QtSimpleRpc::bindSlotAsCustomIncomingCommand(QObject *object, const char *member, QByteArray commandName, bool cacheable)
 {
     connection->mapCommandToSlot(commandName, object, member);
+    if(cacheable)
+        connection->setCommandResponseCacheable(commandName);
 }
 
 void QtSimpleRpc::bindSignalAsCustomOutgoingCommand(QObject *object, const char *signal, QByteArray commandName)
@@ -49,9 +149,19 @@ void QtSimpleRpc::bindSignalAsCustomOutgoingCommand(QObject *object, const char
     connection->mapSignalToCommand(object, signal, commandName);
 }
 
-QVariant QtSimpleRpc::remoteCall(QByteArray commandName, QVariantList arguments, int *errorCode)
+void QtSimpleRpc::setSignalConflationWindow(QObject *object, const char *signal, int window, int keyArgument)
+{
+    connection->setSignalConflationWindow(object, signal, window, keyArgument);
+}
+
+void QtSimpleRpc::setSignalMinimumInterval(QObject *object, const char *signal, int interval, int keyArgument)
+{
+    connection->setSignalMinimumInterval(object, signal, interval, keyArgument);
+}
+
+QVariant QtSimpleRpc::remoteCall(QByteArray commandName, QVariantList arguments, int *errorCode, int timeout)
 {
-    return connection->remoteCall(commandName, arguments, errorCode);
+    return connection->remoteCall(commandName, arguments, errorCode, timeout);
 }
 
 void QtSimpleRpc::remoteCallAsync(QByteArray commandName, QVariantList arguments)
@@ -59,3 +169,78 @@ void QtSimpleRpc::remoteCallAsync(QByteArray commandName, QVariantList arguments
     connection->remoteCallAsync(commandName, arguments);
 }
 
+QVariantList QtSimpleRpc::remoteCallBatch(QList<QPair<QByteArray, QVariantList> > calls, QList<int> *errorCodes, int timeout)
+{
+    return connection->remoteCallBatch(calls, errorCodes, timeout);
+}
+
+QFuture<QVariant> QtSimpleRpc::remoteCallFuture(QByteArray commandName, QVariantList arguments, int timeout, quint32 *requestId)
+{
+    return connection->remoteCallFuture(commandName, arguments, timeout, requestId);
+}
+
+quint32 QtSimpleRpc::remoteCallWithCallback(QByteArray commandName, QVariantList arguments, QObject *receiver, const char *member, int timeout)
+{
+    return connection->remoteCallWithCallback(commandName, arguments, receiver, member, timeout);
+}
+
+quint32 QtSimpleRpc::remoteCallStream(QByteArray commandName, QVariantList arguments, QObject *receiver,
+                                      const char *chunkMember, const char *finishedMember, int window, int timeout)
+{
+    return connection->remoteCallStream(commandName, arguments, receiver, chunkMember, finishedMember, window, timeout);
+}
+
+void QtSimpleRpc::setDefaultCallTimeout(int msec)
+{
+    connection->setDefaultCallTimeout(msec);
+}
+
+void QtSimpleRpc::cancelCall(quint32 requestId)
+{
+    connection->cancelCall(requestId);
+}
+
+void QtSimpleRpc::cancelAllCalls()
+{
+    connection->cancelAllCalls();
+}
+
+void QtSimpleRpc::setParallelDispatchEnabled(bool enabled)
+{
+    connection->setParallelDispatchEnabled(enabled);
+}
+
+void QtSimpleRpc::setCommandOrdered(QByteArray commandName, bool ordered)
+{
+    connection->setCommandOrdered(commandName, ordered);
+}
+
+void QtSimpleRpc::setExecutor(RpcExecutor *executor)
+{
+    connection->setExecutor(executor);
+}
+
+void QtSimpleRpc::setThreadAffineDispatchEnabled(bool enabled)
+{
+    connection->setThreadAffineDispatchEnabled(enabled);
+}
+
+void QtSimpleRpc::setResultCacheSize(int entries)
+{
+    connection->setResultCacheSize(entries);
+}
+
+void QtSimpleRpc::setCommandResultCacheable(QByteArray commandName, bool cacheable, int ttl)
+{
+    connection->setCommandResultCacheable(commandName, cacheable, ttl);
+}
+
+void QtSimpleRpc::setCacheInvalidatedBy(QByteArray incomingCommand, QByteArray cachedCommand)
+{
+    connection->setCacheInvalidatedBy(incomingCommand, cachedCommand);
+}
+
+void QtSimpleRpc::invalidateCachedResults(QByteArray commandName)
+{
+    connection->invalidateCachedResults(commandName);
+}
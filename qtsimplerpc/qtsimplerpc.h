@@ -6,32 +6,150 @@
 #include <QObject>
 #include <QIODevice>
 #include <QVariantList>
+#include <QFuture>
+#include <QPair>
 
 class RpcConnection;
+class RpcExecutor;
 
 class QTSIMPLERPC_EXPORT QtSimpleRpc : public QObject
 {
     Q_OBJECT
 
 public:
+    //! See RpcConnection::SignalCongestionPolicy, ConflateSignals is the default
+    enum SignalCongestionPolicy {
+        BlockSignals,
+        DropSignals,
+        ConflateSignals
+    };
+
+    //! See RpcConnection::ErrorCode
+    enum ErrorCode {
+        NoError = 0,
+        SystemError = 1,
+        ParseError = 2,
+        MessageTooLargeError = 3,
+        TimeoutError = 4,
+        CanceledError = 5,
+        BusyError = 6
+    };
+
     explicit QtSimpleRpc(QObject *parent = 0);
 
     template<class QObjectSubclass> static void registerEnumsOfClass() { registerEnumsOfMetaObject(&QObjectSubclass::staticMetaObject); }
     static void registerEnumsOfMetaObject(const QMetaObject *metaObject);
 
+    QFuture<QVariant> remoteCallFuture(QByteArray commandName, QVariantList arguments, int timeout = -1, quint32 *requestId = 0);
+    quint32 remoteCallWithCallback(QByteArray commandName, QVariantList arguments, QObject *receiver, const char *member, int timeout = -1);
+    //! See RpcConnection::remoteCallStream()
+    quint32 remoteCallStream(QByteArray commandName, QVariantList arguments, QObject *receiver,
+                             const char *chunkMember, const char *finishedMember, int window = 16, int timeout = -1);
+
 public slots:
     void setPeerDevice(QIODevice *peerDevice);
     QIODevice *peerDevice() const;
+
+    //! Switches to length-prefixed binary framing (the peer must support it)
+    //! or back to the newline delimited default.
+    void setBinaryFramingEnabled(bool enabled);
+    bool isBinaryFramingEnabled() const;
+
+    //! Negotiates the encoding of arguments and results with the peer. Available
+    //! codecs are "json" (default) and "datastream", a compact binary codec
+    //! which requires binary framing.
+    void setCodec(const QByteArray &codecName);
+    QByteArray codec() const;
+
+    //! Negotiates compression of frames of at least \arg threshold bytes with
+    //! the peer. Available compressors are "zlib" and "none" (default).
+    //! Requires binary framing.
+    void setCompression(const QByteArray &compressorName, int threshold = 1024);
+    QByteArray compression() const;
+
+    //! Lets the peer switch to binary framing, or the named codec or
+    //! compressor. Nothing is accepted by default, other than what was set
+    //! with the functions above.
+    void setBinaryFramingAccepted(bool accepted);
+    void setCodecAccepted(const QByteArray &codecName, bool accepted = true);
+    void setCompressionAccepted(const QByteArray &compressorName, bool accepted = true);
+
+    //! Incoming messages larger than \arg bytes (default 64 MiB, 0 for the
+    //! largest size a buffer can hold, 1 GiB) are dropped without buffering
+    //! them and answered with an error.
+    void setMaximumMessageSize(int bytes);
+
+    //! Outgoing messages are collected and written at once, \arg msec after
+    //! the first one (default 0: in the next event loop iteration) or as soon
+    //! as \arg thresholdBytes are collected (default 64 KiB).
+    void setWriteCoalescing(int msec, int thresholdBytes);
+    //! Writes all collected outgoing messages now
+    void flushNow();
+
+    //! Flow control: the connection is congested once \arg high bytes wait to
+    //! be written and drained once they fall to \arg low bytes. While congested,
+    //! forwarded signals are handled according to \arg policy.
+    void setWriteWatermarks(int high, int low);
+    void setSignalCongestionPolicy(SignalCongestionPolicy policy);
+    //! Sends the signals forwarded within \arg msec (0: one event loop
+    //! iteration) as a single message; -1 (default) sends each right away.
+    //! The peer must support this.
+    void setSignalBatchWindow(int msec);
+    //! Only forwards bound signals the peer has subscribed to. The peer
+    //! subscribes the commands bound to it, others with subscribeCommand().
+    void setSignalSubscriptionEnabled(bool enabled);
+    void subscribeCommand(QByteArray commandName);
+    void unsubscribeCommand(QByteArray commandName);
+    bool isCongested() const;
+
+    //! Calls fail with TimeoutError after \arg msec (default 0: never) unless
+    //! a timeout is passed to the call itself.
+    void setDefaultCallTimeout(int msec);
+    void cancelCall(quint32 requestId);
+    void cancelAllCalls();
+
+    //! Runs incoming commands in parallel on the global thread pool and
+    //! answers each as soon as it's done. Bound objects must be thread-safe.
+    //! Ordered commands run one after another in the order they arrived.
+    void setParallelDispatchEnabled(bool enabled);
+    void setCommandOrdered(QByteArray commandName, bool ordered = true);
+    //! Runs parallel and asynchronous commands on \arg executor (not owned)
+    //! instead of the global thread pool
+    void setExecutor(RpcExecutor *executor);
+    //! Runs incoming commands in the thread of the object they are bound to
+    void setThreadAffineDispatchEnabled(bool enabled);
+
+    //! Caches the results of up to \arg entries calls of cacheable commands
+    //! (default 0: no cache). Results of \arg commandName are kept for \arg
+    //! ttl msec (0: until invalidated) or until the remote end calls one of
+    //! the commands invalidating them.
+    void setResultCacheSize(int entries);
+    void setCommandResultCacheable(QByteArray commandName, bool cacheable = true, int ttl = 0);
+    void setCacheInvalidatedBy(QByteArray incomingCommand, QByteArray cachedCommand);
+    void invalidateCachedResults(QByteArray commandName = QByteArray());
     
     void bindObjectAllMembers(QObject *object);
     void bindObjectAllSlotsIncoming(QObject *object);
     void bindObjectAllSignalsOutgoing(QObject *object);
 
-    void bindSlotAsCustomIncomingCommand(QObject *object, const char *member, QByteArray commandName);
+    //! The encoded responses of \arg cacheable commands are reused for the
+    //! same arguments. Methods can also be declared cacheable with
+    //! Q_CLASSINFO("RpcCacheable", "<space separated method names>").
+    void bindSlotAsCustomIncomingCommand(QObject *object, const char *member, QByteArray commandName, bool cacheable = false);
     void bindSignalAsCustomOutgoingCommand(QObject *object, const char *signal, QByteArray commandName);
+    //! Forwards only the latest emission of a bound signal within \arg window
+    //! msec, or at most one every \arg interval msec, per value of the
+    //! argument \arg keyArgument if given. Conflated emissions aren't queued.
+    void setSignalConflationWindow(QObject *object, const char *signal, int window, int keyArgument = -1);
+    void setSignalMinimumInterval(QObject *object, const char *signal, int interval, int keyArgument = -1);
 
-    QVariant remoteCall(QByteArray commandName, QVariantList arguments, int *errorCode = 0);
+    QVariant remoteCall(QByteArray commandName, QVariantList arguments, int *errorCode = 0, int timeout = -1);
     void remoteCallAsync(QByteArray commandName, QVariantList arguments);
+    QVariantList remoteCallBatch(QList<QPair<QByteArray, QVariantList> > calls, QList<int> *errorCodes = 0, int timeout = -1);
+
+signals:
+    void congested();
+    void drained();
 
 private:
     RpcConnection *connection;
@@ -33,6 +33,15 @@ SOURCES += rpcsignalmapperhelper.cpp \
     rpcsignalmapper.cpp \
     rpcconnection.cpp \
     rpccommandmapper.cpp \
+    rpccodec.cpp \
+    rpccompressor.cpp \
+    rpcserver.cpp \
+    rpcioworker.cpp \
+    rpcexecutor.cpp \
+    rpcdeferredreply.cpp \
+    rpcstreamwriter.cpp \
+    rpcsharedmemorydevice.cpp \
+    rpcsharedbuffer.cpp \
     qjson.cpp \
     qtsimplerpc.cpp
 
@@ -40,6 +49,15 @@ HEADERS += \
     rpcsignalmapper.h \
     rpcconnection.h \
     rpccommandmapper.h \
+    rpccodec.h \
+    rpccompressor.h \
+    rpcserver.h \
+    rpcioworker.h \
+    rpcexecutor.h \
+    rpcdeferredreply.h \
+    rpcstreamwriter.h \
+    rpcsharedmemorydevice.h \
+    rpcsharedbuffer.h \
     qjson.h \
     qtsimplerpc_global.h \
     qtsimplerpc.h
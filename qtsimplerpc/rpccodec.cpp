@@ -0,0 +1,541 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "rpccodec.h"
+#include "qjson.h"
+#include <QDataStream>
+#include <QStringList>
+#include <QtEndian>
+
+//! Lists and maps nested deeper than this are rejected, the decoder recurses
+#define MAX_DATASTREAM_DEPTH 64
+
+
+QHash<QByteArray, RpcCodec *> RpcCodec::customCodecs;
+
+
+RpcCodec *RpcCodec::codec(const QByteArray &name)
+{
+    static RpcJsonCodec jsonCodec;
+    static RpcDataStreamCodec dataStreamCodec;
+
+    if(name == jsonCodec.name())
+        return &jsonCodec;
+    else if(name == dataStreamCodec.name())
+        return &dataStreamCodec;
+    else
+        return customCodecs.value(name);
+}
+
+RpcCodec *RpcCodec::defaultCodec()
+{
+    return codec("json");
+}
+
+void RpcCodec::registerCodec(RpcCodec *codec)
+{
+    if(RpcCodec::codec(codec->name()))
+    {
+        qWarning("Can't register codec \"%s\": name already in use.", codec->name().constData());
+        delete codec;
+        return;
+    }
+    customCodecs.insert(codec->name(), codec);
+}
+
+
+QByteArray RpcJsonCodec::name() const
+{
+    return "json";
+}
+
+bool RpcJsonCodec::isBinary() const
+{
+    return false;
+}
+
+QByteArray RpcJsonCodec::encode(const QVariant &data, bool unknownTypesAsNull, bool *ok) const
+{
+    QJson::EncodeOptions options(QJson::Compact);
+    if(unknownTypesAsNull)
+        options |= QJson::EncodeUnknownTypesAsNull;
+
+    QJson::Error jsonError;
+    QString json = QJson::encode(data, options, &jsonError);
+    if(!jsonError.isNull())
+        qWarning("JSON error: %s", qPrintable(jsonError.text()));
+    if(ok)
+        *ok = jsonError.isNull();
+    return json.toUtf8();
+}
+
+QVariant RpcJsonCodec::decode(const QByteArray &data, bool *ok) const
+{
+    QJson::Error jsonError;
+    QVariant result = QJson::decode(QString::fromUtf8(data.constData(), data.size()), &jsonError);
+    if(ok)
+        *ok = jsonError.isNull();
+    return result;
+}
+
+
+RpcJsonStreamDecoder::RpcJsonStreamDecoder() :
+    topExpect(ExpectValue),
+    tokenType(NoToken),
+    escaped(false),
+    failed(false)
+{
+}
+
+RpcJsonStreamDecoder::~RpcJsonStreamDecoder()
+{
+    qDeleteAll(levels);
+}
+
+bool RpcJsonStreamDecoder::feed(const char *data, int size)
+{
+    int i = 0;
+    while(i < size && !failed)
+    {
+        if(tokenType == StringToken)
+        {
+            // take everything up to the next quote or escape at once
+            int start = i;
+            while(i < size && !escaped && data[i] != '"' && data[i] != '\\')
+                ++i;
+            token.append(data + start, i - start);
+            if(i == size)
+                break;
+
+            char c = data[i++];
+            token += c;
+            if(escaped)
+                escaped = false;
+            else if(c == '\\')
+                escaped = true;
+            else
+                finishToken();
+        }
+        else if(tokenType == ScalarToken && isScalarChar(data[i]))
+        {
+            token += data[i++];
+        }
+        else
+        {
+            // a scalar ends with whatever follows it
+            if(tokenType == ScalarToken)
+                finishToken();
+            if(!failed)
+                processStructure(data[i++]);
+        }
+    }
+    return !failed;
+}
+
+QVariant RpcJsonStreamDecoder::finish(bool *ok)
+{
+    if(tokenType == ScalarToken)
+        finishToken();
+    bool valid = !failed && tokenType == NoToken && levels.isEmpty() && topExpect == ExpectNothing;
+    if(ok)
+        *ok = valid;
+    return valid ? result : QVariant();
+}
+
+RpcJsonStreamDecoder::Expectation &RpcJsonStreamDecoder::expectation()
+{
+    return levels.isEmpty() ? topExpect : levels.last()->expect;
+}
+
+void RpcJsonStreamDecoder::processStructure(char c)
+{
+    Expectation &expect = expectation();
+    bool valueExpected = (expect == ExpectValue || expect == ExpectValueOrEnd);
+
+    switch(c)
+    {
+    case(' '):
+    case('\t'):
+    case('\r'):
+    case('\n'):
+        break;
+    case('['):
+    case('{'):
+    {
+        if(!valueExpected) {
+            failed = true;
+            break;
+        }
+        Level *level = new Level;
+        level->object = (c == '{');
+        level->expect = level->object ? ExpectKeyOrEnd : ExpectValueOrEnd;
+        levels << level;
+        break;
+    }
+    case(']'):
+    case('}'):
+    {
+        if(levels.isEmpty() || levels.last()->object != (c == '}') ||
+           (expect != ExpectCommaOrEnd && expect != ExpectValueOrEnd && expect != ExpectKeyOrEnd)) {
+            failed = true;
+            break;
+        }
+        Level *level = levels.takeLast();
+        QVariant value = level->object ? QVariant(level->map) : QVariant(level->list);
+        delete level;
+        addValue(value, false);
+        break;
+    }
+    case(','):
+        if(levels.isEmpty() || expect != ExpectCommaOrEnd)
+            failed = true;
+        else
+            expect = levels.last()->object ? ExpectKey : ExpectValue;
+        break;
+    case(':'):
+        if(expect != ExpectColon)
+            failed = true;
+        else
+            expect = ExpectValue;
+        break;
+    case('"'):
+        if(!valueExpected && expect != ExpectKey && expect != ExpectKeyOrEnd) {
+            failed = true;
+            break;
+        }
+        tokenType = StringToken;
+        token = "\"";
+        escaped = false;
+        break;
+    default:
+        if(!valueExpected || !isScalarChar(c)) {
+            failed = true;
+            break;
+        }
+        tokenType = ScalarToken;
+        token = QByteArray(1, c);
+        break;
+    }
+}
+
+void RpcJsonStreamDecoder::finishToken()
+{
+    // single values are decoded like the whole message would be
+    bool isString = (tokenType == StringToken);
+    QJson::Error jsonError;
+    QVariant value = QJson::decode(QString::fromUtf8(token.constData(), token.size()), &jsonError);
+    tokenType = NoToken;
+    token.clear();
+    if(jsonError.isError())
+        failed = true;
+    else
+        addValue(value, isString);
+}
+
+void RpcJsonStreamDecoder::addValue(const QVariant &value, bool isString)
+{
+    Expectation &expect = expectation();
+    if(expect == ExpectKey || expect == ExpectKeyOrEnd)
+    {
+        if(!isString) {
+            failed = true;
+            return;
+        }
+        levels.last()->key = value.toString();
+        expect = ExpectColon;
+        return;
+    }
+    if(expect != ExpectValue && expect != ExpectValueOrEnd) {
+        failed = true;
+        return;
+    }
+
+    if(levels.isEmpty()) {
+        result = value;
+        expect = ExpectNothing;
+        return;
+    }
+    Level *level = levels.last();
+    if(level->object)
+        level->map.insert(level->key, value);
+    else
+        level->list << value;
+    expect = ExpectCommaOrEnd;
+}
+
+bool RpcJsonStreamDecoder::isScalarChar(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            c == '-' || c == '+' || c == '.';
+}
+
+
+QByteArray RpcDataStreamCodec::name() const
+{
+    return "datastream";
+}
+
+bool RpcDataStreamCodec::isBinary() const
+{
+    return true;
+}
+
+QByteArray RpcDataStreamCodec::encode(const QVariant &data, bool unknownTypesAsNull, bool *ok) const
+{
+    bool streamable = true;
+    QVariant value = streamableVariant(data, unknownTypesAsNull, &streamable);
+    if(ok)
+        *ok = streamable;
+    if(!streamable)
+        return QByteArray();
+
+    QByteArray encoded;
+    QDataStream stream(&encoded, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << value;
+    return encoded;
+}
+
+//! Types whose streamed form has a fixed size, which can be decoded
+//! without checking any lengths
+static bool isFixedSizeType(quint32 type)
+{
+    switch(type)
+    {
+    case(QVariant::Bool):
+    case(QVariant::Int):
+    case(QVariant::UInt):
+    case(QVariant::LongLong):
+    case(QVariant::ULongLong):
+    case(QVariant::Double):
+    case(QMetaType::Float):
+    case(QVariant::Char):
+    case(QVariant::Date):
+    case(QVariant::Time):
+    case(QVariant::DateTime):
+        return true;
+    default:
+        return false;
+    }
+}
+
+QVariant RpcDataStreamCodec::decode(const QByteArray &data, bool *ok) const
+{
+    // QDataStream's container operators reserve memory for whatever count
+    // they read, so containers are read element by element here
+    QVariant result;
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_4_6);
+    bool valid = readVariant(stream, &result, 0);
+    if(ok)
+        *ok = valid && (stream.status() == QDataStream::Ok);
+    return valid ? result : QVariant();
+}
+
+bool RpcDataStreamCodec::readVariant(QDataStream &stream, QVariant *value, int depth)
+{
+    if(depth > MAX_DATASTREAM_DEPTH)
+        return false;
+
+    // same layout as QVariant's stream operator: type, null flag, value
+    qint64 start = stream.device()->pos();
+    quint32 type;
+    qint8 isNull;
+    stream >> type >> isNull;
+    if(stream.status() != QDataStream::Ok)
+        return false;
+
+    switch(type)
+    {
+    case(QVariant::Invalid):
+    {
+        // followed by a null string
+        QString placeholder;
+        *value = QVariant();
+        return readSized(stream, &placeholder);
+    }
+    case(QVariant::String):
+    {
+        QString string;
+        if(!readSized(stream, &string))
+            return false;
+        *value = string;
+        return true;
+    }
+    case(QVariant::ByteArray):
+    {
+        QByteArray bytes;
+        if(!readSized(stream, &bytes))
+            return false;
+        *value = bytes;
+        return true;
+    }
+    case(QVariant::StringList):
+    {
+        quint32 count;
+        if(!readCount(stream, 4, &count))
+            return false;
+        QStringList list;
+        list.reserve(count);
+        for(quint32 i = 0; i < count; ++i)
+        {
+            QString string;
+            if(!readSized(stream, &string))
+                return false;
+            list << string;
+        }
+        *value = list;
+        return true;
+    }
+    case(QVariant::List):
+    {
+        // an element takes at least its type and null flag
+        quint32 count;
+        if(!readCount(stream, 5, &count))
+            return false;
+        QVariantList list;
+        list.reserve(count);
+        for(quint32 i = 0; i < count; ++i)
+        {
+            QVariant element;
+            if(!readVariant(stream, &element, depth + 1))
+                return false;
+            list << element;
+        }
+        *value = list;
+        return true;
+    }
+    case(QVariant::Map):
+    case(QVariant::Hash):
+    {
+        // an entry takes at least a string length and an element
+        quint32 count;
+        if(!readCount(stream, 9, &count))
+            return false;
+        QVariantMap map;
+        QVariantHash hash;
+        for(quint32 i = 0; i < count; ++i)
+        {
+            QString key;
+            QVariant element;
+            if(!readSized(stream, &key) || !readVariant(stream, &element, depth + 1))
+                return false;
+            if(type == QVariant::Map)
+                map.insert(key, element);
+            else
+                hash.insert(key, element);
+        }
+        *value = (type == QVariant::Map) ? QVariant(map) : QVariant(hash);
+        return true;
+    }
+    default:
+        if(!isFixedSizeType(type))
+        {
+            qWarning("Received value of type %u, which can't be decoded! Ignoring.", type);
+            return false;
+        }
+        // QVariant can read values of a fixed size itself
+        stream.device()->seek(start);
+        stream >> *value;
+        return (stream.status() == QDataStream::Ok);
+    }
+}
+
+bool RpcDataStreamCodec::readCount(QDataStream &stream, quint32 minElementSize, quint32 *count)
+{
+    stream >> *count;
+    return (stream.status() == QDataStream::Ok &&
+            *count <= stream.device()->bytesAvailable() / minElementSize);
+}
+
+template <typename T>
+bool RpcDataStreamCodec::readSized(QDataStream &stream, T *value)
+{
+    // the length in bytes (0xffffffff for null) precedes the data
+    QByteArray lengthBytes = stream.device()->peek(4);
+    if(lengthBytes.size() < 4)
+        return false;
+    quint32 length = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(lengthBytes.constData()));
+    if(length != 0xffffffff && length > stream.device()->bytesAvailable() - 4)
+        return false;
+
+    stream >> *value;
+    return (stream.status() == QDataStream::Ok);
+}
+
+QVariant RpcDataStreamCodec::streamableVariant(const QVariant &data, bool unknownTypesAsNull, bool *ok)
+{
+    // QVariant can only stream user types with registered stream operators,
+    // so replace them the same way the JSON codec does
+    switch(data.type())
+    {
+    case QVariant::List:
+    {
+        QVariantList list = data.toList();
+        for(int i = 0; i < list.count() && *ok; ++i)
+            list[i] = streamableVariant(list.at(i), unknownTypesAsNull, ok);
+        return list;
+    }
+    case QVariant::Map:
+    {
+        QVariantMap map = data.toMap();
+        for(QVariantMap::iterator i = map.begin(); i != map.end() && *ok; ++i)
+            i.value() = streamableVariant(i.value(), unknownTypesAsNull, ok);
+        return map;
+    }
+    case QVariant::Hash:
+    {
+        QVariantHash hash = data.toHash();
+        for(QVariantHash::iterator i = hash.begin(); i != hash.end() && *ok; ++i)
+            i.value() = streamableVariant(i.value(), unknownTypesAsNull, ok);
+        return hash;
+    }
+    case QVariant::UserType:
+        if(QJson::isMetaTypeTreatedAsInteger(data.userType()))
+        {
+            // reinterpret the internal contents of the variant
+            return QVariant(*reinterpret_cast<const int*>(data.constData()));
+        }
+        else if(!unknownTypesAsNull)
+        {
+            qWarning("Can't encode value of type %s.", data.typeName());
+            *ok = false;
+        }
+        return QVariant();
+    case QVariant::Invalid:
+    case QVariant::String:
+    case QVariant::ByteArray:
+    case QVariant::StringList:
+        return data;
+    default:
+        // only send what the peer's decoder accepts
+        if(isFixedSizeType(data.type()))
+            return data;
+        if(!unknownTypesAsNull)
+        {
+            qWarning("Can't encode value of type %s.", data.typeName());
+            *ok = false;
+        }
+        return QVariant();
+    }
+}
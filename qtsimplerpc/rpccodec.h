@@ -0,0 +1,155 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef RPCCODEC_H
+#define RPCCODEC_H
+
+#include <QByteArray>
+#include <QVariant>
+#include <QHash>
+#include <QList>
+
+class QDataStream;
+
+//! Encodes and decodes the arguments and results of RPC messages. The codec
+//! of a connection is negotiated with the peer by its name.
+class RpcCodec
+{
+public:
+    virtual ~RpcCodec() {}
+
+    //! The name under which the codec is negotiated with the peer
+    virtual QByteArray name() const = 0;
+    //! Returns true if encoded data may contain any bytes, including the
+    //! message delimiter of the line protocol. Such codecs require binary framing.
+    virtual bool isBinary() const = 0;
+
+    //! Encodes data. Values of unsupported types let the encoding fail unless
+    //! \arg unknownTypesAsNull is set, in which case they are encoded as null.
+    virtual QByteArray encode(const QVariant &data, bool unknownTypesAsNull, bool *ok) const = 0;
+    virtual QVariant decode(const QByteArray &data, bool *ok) const = 0;
+
+    //! Returns the built-in or registered codec with the given name, or 0
+    static RpcCodec *codec(const QByteArray &name);
+    //! Returns the codec every peer understands (JSON)
+    static RpcCodec *defaultCodec();
+    //! Makes a custom codec available for negotiation. Takes ownership.
+    static void registerCodec(RpcCodec *codec);
+
+private:
+    static QHash<QByteArray, RpcCodec *> customCodecs;
+};
+
+//! Text codec based on QJson. This is the default and the only codec
+//! available with line framing.
+class RpcJsonCodec : public RpcCodec
+{
+public:
+    QByteArray name() const;
+    bool isBinary() const;
+    QByteArray encode(const QVariant &data, bool unknownTypesAsNull, bool *ok) const;
+    QVariant decode(const QByteArray &data, bool *ok) const;
+};
+
+//! Decodes JSON fed in pieces as it arrives, so a large message doesn't
+//! have to be buffered as text and then decoded at once. Yields the same
+//! values as RpcJsonCodec. Nesting doesn't recurse, so it isn't limited.
+class RpcJsonStreamDecoder
+{
+public:
+    RpcJsonStreamDecoder();
+    ~RpcJsonStreamDecoder();
+
+    //! Parses the next piece of UTF-8 encoded JSON; false once it's invalid
+    bool feed(const char *data, int size);
+    //! Ends the data; \arg ok tells whether it held exactly one valid value
+    QVariant finish(bool *ok);
+
+private:
+    Q_DISABLE_COPY(RpcJsonStreamDecoder)
+
+    //! What may come next in an array, object or at the top level
+    enum Expectation {
+        ExpectValue,
+        ExpectValueOrEnd,
+        ExpectKey,
+        ExpectKeyOrEnd,
+        ExpectColon,
+        ExpectCommaOrEnd,
+        ExpectNothing
+    };
+    enum TokenType {
+        NoToken,
+        StringToken,
+        ScalarToken
+    };
+    //! An array or object being filled
+    struct Level {
+        bool object;
+        QVariantList list;
+        QVariantMap map;
+        QString key;
+        Expectation expect;
+    };
+
+    QList<Level *> levels;
+    Expectation topExpect;
+    //! The string (with quotes) or number / keyword being collected
+    TokenType tokenType;
+    QByteArray token;
+    bool escaped;
+    QVariant result;
+    bool failed;
+
+    Expectation &expectation();
+    void processStructure(char c);
+    void finishToken();
+    void addValue(const QVariant &value, bool isString);
+    static bool isScalarChar(char c);
+};
+
+//! Compact binary codec based on QDataStream. Numbers and byte arrays are
+//! transferred without any text conversion. Decoding only accepts the types
+//! the encoder produces (numbers, strings, byte arrays, dates and times,
+//! lists, maps and hashes) and checks every length and element count
+//! against the data left, so a peer can't make it allocate more memory
+//! than it has sent.
+class RpcDataStreamCodec : public RpcCodec
+{
+public:
+    QByteArray name() const;
+    bool isBinary() const;
+    QByteArray encode(const QVariant &data, bool unknownTypesAsNull, bool *ok) const;
+    QVariant decode(const QByteArray &data, bool *ok) const;
+
+private:
+    static QVariant streamableVariant(const QVariant &data, bool unknownTypesAsNull, bool *ok);
+    static bool readVariant(QDataStream &stream, QVariant *value, int depth);
+    //! Reads the element count of a container whose elements take at least
+    //! \arg minElementSize bytes each
+    static bool readCount(QDataStream &stream, quint32 minElementSize, quint32 *count);
+    //! Reads a string or byte array, checking its length first
+    template <typename T> static bool readSized(QDataStream &stream, T *value);
+};
+
+#endif // RPCCODEC_H
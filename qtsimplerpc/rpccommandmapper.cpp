@@ -22,66 +22,108 @@
 ****************************************************************************/
 
 #include "rpccommandmapper.h"
+#include "rpcdeferredreply.h"
+#include "rpcstreamwriter.h"
+#include "rpcsharedbuffer.h"
 #include <QMetaMethod>
 #include <QDebug>
 #include <QThread>
 #include <QMutex>
+#include <QPointer>
+#include <QRunnable>
+#include <QEvent>
+#include <QCoreApplication>
 
+#define DEFAULT_RESPONSE_CACHE_SIZE (4 * 1024 * 1024)
 
-RpcCommandMapper::RpcCommandMapper(QObject *parent) :
-    QObject(parent)
-{
-}
 
-RpcCommandMapper::CommandResult RpcCommandMapper::runCommand(const QByteArray &commandName, const QVariantList &arguments)
+//! Runs jobs posted to it in the thread it lives in
+class RpcInvoker : public QObject
 {
-    if(!mappings.contains(commandName))
-        return CommandResult(CommandDoesntExistError, QVariant());
+public:
+    static const QEvent::Type invokeEventType;
 
-    ObjectSlot objectSlot = mappings.value(commandName);
-    QObject *obj = objectSlot.obj;
-    const QMetaObject *mo = obj->metaObject();
-    QByteArray memberName = objectSlot.memberName;
+    class InvokeEvent : public QEvent
+    {
+    public:
+        QRunnable *job;
+        InvokeEvent(QRunnable *job) : QEvent(invokeEventType), job(job) {}
+    };
 
-    /*
-    qDebug("Found mapping: %s => %s::%s(...)", commandName.constData(),
-           mo->className(), memberName.constData());
-    */
+    bool event(QEvent *event)
+    {
+        if(event->type() != invokeEventType)
+            return QObject::event(event);
+
+        // the job may delete itself
+        QRunnable *job = static_cast<InvokeEvent *>(event)->job;
+        bool deleteJob = job->autoDelete();
+        job->run();
+        if(deleteJob)
+            delete job;
+        return true;
+    }
+};
 
-    // Search for meta methods with given name (no signature check here!)
-    QList<QMetaMethod> methods;
-    for(int i = 0; i < mo->methodCount(); ++i)
-        if(QByteArray(mo->method(i).signature()).startsWith(memberName + "(")) // ignore parameters
-            methods << mo->method(i);
+const QEvent::Type RpcInvoker::invokeEventType = QEvent::Type(QEvent::registerEventType());
 
+//! One invoker per thread, created on first use and deleted when the thread finishes
+struct RpcThreadInvoker
+{
+    QPointer<QThread> thread;
+    QPointer<RpcInvoker> invoker;
+};
+static QMutex invokersMutex;
+static QHash<QThread *, RpcThreadInvoker> invokers;
+
+
+RpcCommandMapper::RpcCommandMapper(QObject *parent) :
+    QObject(parent),
+    responseCache(DEFAULT_RESPONSE_CACHE_SIZE)
+{
+    // parameter and return types of deferred commands
+    qRegisterMetaType<RpcDeferredReply>("RpcDeferredReply");
+    qRegisterMetaType<RpcStreamWriter>("RpcStreamWriter");
+    qRegisterMetaType<RpcSharedBuffer>("RpcSharedBuffer");
+    qRegisterMetaType<QFuture<QVariant> >("QFuture<QVariant>");
+}
+
+RpcCommandMapper::CommandResult RpcCommandMapper::runCommand(const QByteArray &commandName, const QVariantList &arguments)
+{
+    mappingsLock.lockForRead();
+    QHash<QByteArray, ObjectSlot>::const_iterator mapping = mappings.constFind(commandName);
     //if no method with this name exist, the command doesn't exist
-    if(methods.count() == 0)
+    if(mapping == mappings.constEnd() || mapping.value().overloads.isEmpty()) {
+        mappingsLock.unlock();
         return CommandResult(CommandDoesntExistError, QVariant());
-
-    //we first check if the argument count can match one of the signatures, because this is fast:
-    for(int i = 0; i < methods.count(); ++i) {
-        //qDebug() << methods.at(i).signature();
-        if(methods.at(i).parameterTypes().count() != arguments.count())
-            methods.removeAt(i--);
     }
+    QObject *obj = mapping.value().obj;
+    //only the overloads taking as many arguments can match
+    QList<QMetaMethod> methods = mapping.value().overloads.value(arguments.count());
+    mappingsLock.unlock();
 
     //if no method is left, none can match the signatures available
     if(methods.count() == 0)
         return CommandResult(CommandSignatureMismatchError, QVariant());
 
-    //in the next step, we compare the signatures of the remaining methods with the types in the argument list
+    //in the next step, we compare the signatures of the remaining methods with the types in the argument list.
+    //exact types are tried first, so overloads only differing in types accepting the same arguments
+    //(like QString and QByteArray or int and qlonglong) can still be told apart
     QMetaMethod matchingMethod;
-    foreach(QMetaMethod method, methods)
+    for(int pass = 0; pass < 2 && !matchingMethod.enclosingMetaObject(); ++pass)
     {
-        if(checkSignature(method, arguments))
+        foreach(QMetaMethod method, methods)
         {
-            //enclosingMetaObject is non-NULL if matchingMethod has been set
-            if(matchingMethod.enclosingMetaObject())
+            if(checkSignature(method, arguments, pass == 0))
             {
-                qWarning("Multiple argument type matches found for command \"%s\". Treating as signature mismatch.", commandName.constData());
-                return CommandResult(CommandSignatureMismatchError, QVariant());
+                //enclosingMetaObject is non-NULL if matchingMethod has been set
+                if(matchingMethod.enclosingMetaObject())
+                {
+                    qWarning("Multiple argument type matches found for command \"%s\". Treating as signature mismatch.", commandName.constData());
+                    return CommandResult(CommandSignatureMismatchError, QVariant());
+                }
+                matchingMethod = method;
             }
-            matchingMethod = method;
         }
     }
 
@@ -89,7 +131,20 @@ RpcCommandMapper::CommandResult RpcCommandMapper::runCommand(const QByteArray &c
     if(!matchingMethod.enclosingMetaObject())
         return CommandResult(CommandSignatureMismatchError, QVariant());
 
-    return variantMetacall(obj, matchingMethod, arguments);
+    //deferred commands answer later, through the reply handle or the returned future
+    QByteArray handleType = replyHandleType(matchingMethod);
+    if(!handleType.isEmpty())
+    {
+        QVariant handle = (handleType == "RpcStreamWriter")
+                ? QVariant::fromValue(RpcStreamWriter::create())
+                : QVariant::fromValue(RpcDeferredReply::create());
+        variantMetacall(obj, matchingMethod, QVariantList(arguments) << handle);
+        return CommandResult(DeferredResult, handle);
+    }
+    QVariant returnValue = variantMetacall(obj, matchingMethod, arguments);
+    if(returnValue.userType() == qMetaTypeId<QFuture<QVariant> >())
+        return CommandResult(DeferredResult, returnValue);
+    return returnValue;
 }
 
 void RpcCommandMapper::addMapping(const QByteArray &commandName, QObject *object, const char *member)
@@ -104,13 +159,149 @@ void RpcCommandMapper::addMapping(const QByteArray &commandName, QObject *object
     ObjectSlot slot;
     slot.obj = object;
     slot.memberName = memberName;
+
+    // Search for meta methods with given name and group them by the number of
+    // arguments the remote end passes (the types are checked for each call)
+    const QMetaObject *mo = object->metaObject();
+    QByteArray prefix = memberName + "(";
+    for(int i = 0; i < mo->methodCount(); ++i)
+    {
+        QMetaMethod method = mo->method(i);
+        if(!QByteArray(method.signature()).startsWith(prefix)) // ignore parameters
+            continue;
+        int parameterCount = method.parameterTypes().count();
+        if(!replyHandleType(method).isEmpty())
+            --parameterCount; // not passed by the remote end
+        slot.overloads[parameterCount] << method;
+    }
+
+    QWriteLocker locker(&mappingsLock);
     mappings.insertMulti(commandName, slot);
+
+    int classInfo = mo->indexOfClassInfo("RpcCacheable");
+    if(classInfo != -1 && QByteArray(mo->classInfo(classInfo).value()).simplified().split(' ').contains(memberName))
+        cacheableCommands.insert(commandName);
+}
+
+void RpcCommandMapper::addAllMappings(QObject *object)
+{
+    const QMetaObject *mo = object->metaObject();
+    // skip QObject's members
+    for(int i = QObject::staticMetaObject.methodCount(); i < mo->methodCount(); ++i)
+    {
+        if(mo->method(i).methodType() == QMetaMethod::Slot ||
+            mo->method(i).methodType() == QMetaMethod::Method)
+        {
+            //qDebug("Found method: %s", mo->method(i).signature());
+            QByteArray memberName = mo->method(i).signature();
+            memberName = memberName.left(memberName.indexOf('(')); // remove arguments
+            addMapping(memberName, object, memberName.constData());
+        }
+    }
+}
+
+void RpcCommandMapper::setCommandOrdered(const QByteArray &commandName, bool ordered)
+{
+    QWriteLocker locker(&mappingsLock);
+    if(ordered)
+        orderedCommands.insert(commandName);
+    else
+        orderedCommands.remove(commandName);
+}
+
+bool RpcCommandMapper::isCommandOrdered(const QByteArray &commandName) const
+{
+    QReadLocker locker(&mappingsLock);
+    return orderedCommands.contains(commandName);
+}
+
+void RpcCommandMapper::setCommandResponseCacheable(const QByteArray &commandName, bool cacheable)
+{
+    QWriteLocker locker(&mappingsLock);
+    if(cacheable)
+        cacheableCommands.insert(commandName);
+    else
+        cacheableCommands.remove(commandName);
+}
+
+bool RpcCommandMapper::isCommandResponseCacheable(const QByteArray &commandName) const
+{
+    QReadLocker locker(&mappingsLock);
+    return cacheableCommands.contains(commandName);
+}
+
+void RpcCommandMapper::setResponseCacheSize(int bytes)
+{
+    QMutexLocker locker(&responseCacheMutex);
+    responseCache.setMaxCost(qMax(bytes, 0));
+}
+
+bool RpcCommandMapper::findCachedResponse(const QByteArray &key, QByteArray *response)
+{
+    QMutexLocker locker(&responseCacheMutex);
+    QByteArray *cached = responseCache.object(key);
+    if(!cached)
+        return false;
+    *response = *cached;
+    return true;
 }
 
-bool RpcCommandMapper::checkSignature(QMetaMethod method, const QVariantList &arguments)
+void RpcCommandMapper::storeCachedResponse(const QByteArray &key, const QByteArray &response)
+{
+    QMutexLocker locker(&responseCacheMutex);
+    responseCache.insert(key, new QByteArray(response), key.size() + response.size());
+}
+
+QThread *RpcCommandMapper::commandThread(const QByteArray &commandName) const
+{
+    QReadLocker locker(&mappingsLock);
+    QHash<QByteArray, ObjectSlot>::const_iterator i = mappings.constFind(commandName);
+    return (i == mappings.constEnd()) ? 0 : i.value().obj->thread();
+}
+
+bool RpcCommandMapper::runInThread(QThread *thread, QRunnable *job)
+{
+    // events posted to a thread that isn't running are never delivered
+    if(!thread->isRunning())
+        return false;
+
+    QMutexLocker locker(&invokersMutex);
+    RpcThreadInvoker entry = invokers.value(thread);
+    if(entry.thread.isNull() || entry.invoker.isNull())
+    {
+        // first job for this thread, or the thread finished (which deleted its
+        // invoker) and was restarted, or a new thread at the address of a
+        // deleted one. Forget the entries of deleted threads on the way.
+        QMutableHashIterator<QThread *, RpcThreadInvoker> i(invokers);
+        while(i.hasNext())
+            if(i.next().value().thread.isNull())
+                i.remove();
+
+        entry.thread = thread;
+        entry.invoker = new RpcInvoker;
+        entry.invoker->moveToThread(thread);
+        // finished() is emitted in the thread itself, which still handles
+        // deferred deletes afterwards
+        connect(thread, SIGNAL(finished()), entry.invoker, SLOT(deleteLater()));
+        invokers.insert(thread, entry);
+    }
+    QCoreApplication::postEvent(entry.invoker, new RpcInvoker::InvokeEvent(job));
+    return true;
+}
+
+QByteArray RpcCommandMapper::replyHandleType(QMetaMethod method)
+{
+    QList<QByteArray> parameterTypes = method.parameterTypes();
+    if(!parameterTypes.isEmpty() &&
+            (parameterTypes.last() == "RpcDeferredReply" || parameterTypes.last() == "RpcStreamWriter"))
+        return parameterTypes.last();
+    return QByteArray();
+}
+
+bool RpcCommandMapper::checkSignature(QMetaMethod method, const QVariantList &arguments, bool exact)
 {
     //This has been checked before...
-    Q_ASSERT(method.parameterTypes().count() == arguments.count());
+    Q_ASSERT(method.parameterTypes().count() == arguments.count() + (replyHandleType(method).isEmpty() ? 0 : 1));
 
     for(int i = 0; i < arguments.count(); ++i)
     {
@@ -118,13 +309,13 @@ bool RpcCommandMapper::checkSignature(QMetaMethod method, const QVariantList &ar
         QByteArray type = method.parameterTypes().at(i);
         //qDebug() << "against provided type:" << type;
         const QVariant & arg = arguments.at(i);
-        if(!checkTypes(type, arg))
+        if(!checkTypes(type, arg, exact))
             return false;
     }
     return true;
 }
 
-bool RpcCommandMapper::checkTypes(const QByteArray &typeDescription, const QVariant &argument)
+bool RpcCommandMapper::checkTypes(const QByteArray &typeDescription, const QVariant &argument, bool exact)
 {
     QByteArray type = normalizeType(typeDescription);
     //qDebug("checking type (normalized): \"%s\" vs \"%s\"", type.constData(), argument.typeName());
@@ -136,10 +327,10 @@ bool RpcCommandMapper::checkTypes(const QByteArray &typeDescription, const QVari
     else if (type.startsWith("QList<"))
     {
         QByteArray entryType = type.mid(6, type.length() - 7).trimmed(); //remove "QList<" and ">"
-        if(argument.type() != QVariant::List)
+        if(argument.type() != QVariant::List && argument.type() != QVariant::StringList)
             return false;
         else
-            return checkList(entryType, argument.toList());
+            return checkList(entryType, argument.toList(), exact);
     }
     else if (type.startsWith("QMap<QString,"))
     {
@@ -147,39 +338,57 @@ bool RpcCommandMapper::checkTypes(const QByteArray &typeDescription, const QVari
         if(argument.type() != QVariant::Map)
             return false;
         else
-            return checkMap(entryType, argument.toMap());
+            return checkMap(entryType, argument.toMap(), exact);
     }
+    else if (exact && (type == "QString" || type == "qlonglong" || type == "double"))
+    {
+        QByteArray declaredType = typeDescription.trimmed();
+        if (declaredType == "long long")
+            declaredType = "qlonglong";
+        return (argument.userType() == QMetaType::type(declaredType.constData()));
+    }
+    // binary codecs don't widen the types like JSON does, so accept all
+    // variants of strings and numbers here
     else if (type == "QString")
     {
-        return (argument.type() == QVariant::String);
+        return (argument.type() == QVariant::String ||
+                argument.type() == QVariant::ByteArray);
     }
     else if (type == "qlonglong")
     {
-        return (argument.type() == QVariant::LongLong);
+        return (argument.type() == QVariant::LongLong ||
+                argument.type() == QVariant::Int ||
+                argument.type() == QVariant::UInt ||
+                argument.type() == QVariant::ULongLong);
     }
     else if (type == "double")
     {
-        return (argument.type() == QVariant::Double);
+        return (argument.type() == QVariant::Double ||
+                argument.userType() == QMetaType::Float);
     }
     else if (type == "bool")
     {
         return (argument.type() == QVariant::Bool);
     }
+    else if (type == "RpcSharedBuffer")
+    {
+        return RpcSharedBuffer::isReference(argument);
+    }
     return false;
 }
 
-bool RpcCommandMapper::checkList(const QByteArray &elementTypeDescription, const QVariantList &argument)
+bool RpcCommandMapper::checkList(const QByteArray &elementTypeDescription, const QVariantList &argument, bool exact)
 {
     foreach(QVariant entry, argument)
-        if(!checkTypes(elementTypeDescription, entry))
+        if(!checkTypes(elementTypeDescription, entry, exact))
             return false;
     return true;
 }
 
-bool RpcCommandMapper::checkMap(const QByteArray &elementTypeDescription, const QVariantMap &argument)
+bool RpcCommandMapper::checkMap(const QByteArray &elementTypeDescription, const QVariantMap &argument, bool exact)
 {
     foreach(QVariant entry, argument)
-        if(!checkTypes(elementTypeDescription, entry))
+        if(!checkTypes(elementTypeDescription, entry, exact))
             return false;
     return true;
 }
@@ -233,6 +442,10 @@ void * RpcCommandMapper::newInstanceOfType(const QByteArray &typeDescription, co
     else if (typeDescription == "QMap<QString,QMap<QString,"#typeName"> >") \
         return (void*) new QMap<QString,QMap<QString,typeName > >(extractMapOfMaps<typeName >(value.toMap()))
 
+    // only a reference is sent, attach to the caller's buffer
+    if (typeDescription == "RpcSharedBuffer")
+        return (void*) new RpcSharedBuffer(RpcSharedBuffer::fromReference(value));
+
     int type = metaType(typeDescription, mo);
     if (type) {
         if (value.canConvert((QVariant::Type)type)) {
@@ -413,7 +626,8 @@ QMap<QString,QMap<QString,T> > RpcCommandMapper::extractMapOfMaps(const QVariant
 
 QList<QByteArray> RpcCommandMapper::listOfCommands() const
 {
-    QList<QByteArray> commands = mappings.keys();
+    QReadLocker locker(&mappingsLock);
+    QList<QByteArray> commands = mappings.uniqueKeys();
     qSort(commands);
     return commands;
 }
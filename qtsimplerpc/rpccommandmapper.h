@@ -29,8 +29,12 @@
 #include <QVariant>
 #include <QMetaMethod>
 #include <QSet>
+#include <QReadWriteLock>
+#include <QMutex>
+#include <QCache>
 
-class QMutex;
+class QThread;
+class QRunnable;
 
 
 class RpcCommandMapper : public QObject
@@ -45,7 +49,8 @@ public:
         //                             ----------------------------------------
         Successful,                    // command return value
         CommandDoesntExistError,       // null
-        CommandSignatureMismatchError  // null (in future versions maybe possible signatures)
+        CommandSignatureMismatchError, // null (in future versions maybe possible signatures)
+        DeferredResult                 // RpcDeferredReply, RpcStreamWriter or QFuture<QVariant> delivering the result later
     };
     struct CommandResult {
         CommandErrorCode code;
@@ -67,7 +72,9 @@ public:
         inline CommandResult(CommandErrorCode code, QVariant value) : code(code), value(value) {}
     };
 
-    //! Locally calls a previously mapped command
+    //! Locally calls a previously mapped command. Mappings may be added and
+    //! commands run from any thread; the mapped objects are called in the
+    //! calling thread.
     CommandResult runCommand(const QByteArray &commandName, const QVariantList &arguments);
 
     //! Maps a command which can then be called using runCommand(). \arg member can be one of
@@ -75,28 +82,70 @@ public:
     //! the SLOT() macro (which will prepend a digit to the signature). Independently from
     //! which type you choose, the parameters are ignored by this function. The appropriate
     //! overload of the member is choosen when the method gets called by runCommand() by
-    //! looking at the types of the provided arguments.
+    //! looking at the types of the provided arguments. Commands mapped to methods listed
+    //! in the class info "RpcCacheable" (space separated names, see Q_CLASSINFO) are
+    //! made cacheable, see setCommandResponseCacheable().
     void addMapping(const QByteArray &commandName, QObject *object, const char *member);
+    //! Maps all slots and invokable methods of \arg object to commands of the same name
+    void addAllMappings(QObject *object);
+
+    //! Ordered commands are run one after another in the order they arrived
+    //! when a connection dispatches commands in parallel
+    void setCommandOrdered(const QByteArray &commandName, bool ordered);
+    bool isCommandOrdered(const QByteArray &commandName) const;
+
+    //! Cacheable commands are pure functions of their arguments, so their
+    //! encoded responses can be kept and sent again for the same arguments
+    void setCommandResponseCacheable(const QByteArray &commandName, bool cacheable);
+    bool isCommandResponseCacheable(const QByteArray &commandName) const;
+    //! Cached responses are kept up to \arg bytes in total (default 4 MiB),
+    //! evicting the least recently used ones
+    void setResponseCacheSize(int bytes);
+    //! Encoded responses of cacheable commands by a key made of the command
+    //! name, codecs and encoded arguments. Used by all connections sharing
+    //! this mapper, from any thread.
+    bool findCachedResponse(const QByteArray &key, QByteArray *response);
+    void storeCachedResponse(const QByteArray &key, const QByteArray &response);
+
+    //! Thread of the object mapped to \arg commandName, 0 if there is none
+    QThread *commandThread(const QByteArray &commandName) const;
+    //! Runs \arg job in \arg thread, which needs a running event loop. The
+    //! job is handed over through an event to a helper object living in that
+    //! thread and deleted after running if it's auto-deleted. Returns false
+    //! without taking the job if the thread isn't running. A thread running
+    //! without an event loop can't be detected, its jobs never run.
+    static bool runInThread(QThread *thread, QRunnable *job);
 
-
-protected:
     /** Returns a list of commands (without signature) */
     QList<QByteArray> listOfCommands() const;
 
+
 private:
     struct ObjectSlot {
         QObject *obj;
         QByteArray memberName;
+        //! Methods of that name by the number of arguments passed by the
+        //! remote end, resolved once in addMapping()
+        QHash<int, QList<QMetaMethod> > overloads;
     };
     QHash<QByteArray, ObjectSlot> mappings;
+    QSet<QByteArray> orderedCommands;
+    QSet<QByteArray> cacheableCommands;
+    mutable QReadWriteLock mappingsLock;
+    //! Looking up an entry reorders the cache, so it needs a plain mutex
+    QCache<QByteArray, QByteArray> responseCache;
+    QMutex responseCacheMutex;
 
     //meta type stuff:
     static QVariant variantMetacall(QObject *obj, QMetaMethod method, const QVariantList &arguments);
 
-    static bool checkSignature(QMetaMethod method, const QVariantList &arguments);
-    static bool checkTypes(const QByteArray &typeDescription, const QVariant &argument);
-    static bool checkList(const QByteArray &elementTypeDescription, const QVariantList &argument);
-    static bool checkMap(const QByteArray &elementTypeDescription, const QVariantMap &argument);
+    static QByteArray replyHandleType(QMetaMethod method);
+    //! With \arg exact, strings and numbers only match the very type they
+    //! are declared with instead of any type the codecs may decode them to
+    static bool checkSignature(QMetaMethod method, const QVariantList &arguments, bool exact);
+    static bool checkTypes(const QByteArray &typeDescription, const QVariant &argument, bool exact);
+    static bool checkList(const QByteArray &elementTypeDescription, const QVariantList &argument, bool exact);
+    static bool checkMap(const QByteArray &elementTypeDescription, const QVariantMap &argument, bool exact);
 
     static QByteArray normalizeType(const QByteArray &typeDescription);
     static int metaType(const QByteArray &typeDescription, const QMetaObject *mo);
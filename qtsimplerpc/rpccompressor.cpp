@@ -0,0 +1,79 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "rpccompressor.h"
+#include <QtEndian>
+
+
+QHash<QByteArray, RpcCompressor *> RpcCompressor::customCompressors;
+
+
+RpcCompressor *RpcCompressor::compressor(const QByteArray &name)
+{
+    static RpcZlibCompressor zlibCompressor;
+
+    if(name == zlibCompressor.name())
+        return &zlibCompressor;
+    else
+        return customCompressors.value(name);
+}
+
+void RpcCompressor::registerCompressor(RpcCompressor *compressor)
+{
+    if(compressor->name() == "none" || RpcCompressor::compressor(compressor->name()))
+    {
+        qWarning("Can't register compressor \"%s\": name already in use.", compressor->name().constData());
+        delete compressor;
+        return;
+    }
+    customCompressors.insert(compressor->name(), compressor);
+}
+
+
+RpcZlibCompressor::RpcZlibCompressor(int compressionLevel) :
+    level(compressionLevel)
+{
+}
+
+QByteArray RpcZlibCompressor::name() const
+{
+    return "zlib";
+}
+
+QByteArray RpcZlibCompressor::compress(const QByteArray &data) const
+{
+    return qCompress(data, level);
+}
+
+QByteArray RpcZlibCompressor::decompress(const QByteArray &data) const
+{
+    return qUncompress(data);
+}
+
+qint64 RpcZlibCompressor::decompressedSize(const QByteArray &data) const
+{
+    // qCompress() prepends the size, which qUncompress() allocates up front
+    if(data.size() < 4)
+        return -1;
+    return qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data.constData()));
+}
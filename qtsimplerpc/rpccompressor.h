@@ -0,0 +1,72 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef RPCCOMPRESSOR_H
+#define RPCCOMPRESSOR_H
+
+#include <QByteArray>
+#include <QHash>
+
+//! Compresses the payload of binary frames. The compressor of a connection
+//! is negotiated with the peer by its name. Implementations may use a preset
+//! dictionary shared by both peers, which pays off for small messages.
+class RpcCompressor
+{
+public:
+    virtual ~RpcCompressor() {}
+
+    //! The name under which the compressor is negotiated with the peer
+    virtual QByteArray name() const = 0;
+
+    virtual QByteArray compress(const QByteArray &data) const = 0;
+    //! Returns an empty byte array if \arg data is corrupt
+    virtual QByteArray decompress(const QByteArray &data) const = 0;
+    //! The size \arg data claims to have decompressed, checked against the
+    //! message size limit before decompressing. -1 if the format doesn't tell.
+    virtual qint64 decompressedSize(const QByteArray &data) const { Q_UNUSED(data); return -1; }
+
+    //! Returns the built-in or registered compressor with the given name, or 0
+    static RpcCompressor *compressor(const QByteArray &name);
+    //! Makes a custom compressor available for negotiation. Takes ownership.
+    static void registerCompressor(RpcCompressor *compressor);
+
+private:
+    static QHash<QByteArray, RpcCompressor *> customCompressors;
+};
+
+//! zlib compression using qCompress() / qUncompress()
+class RpcZlibCompressor : public RpcCompressor
+{
+public:
+    explicit RpcZlibCompressor(int compressionLevel = -1);
+
+    QByteArray name() const;
+    QByteArray compress(const QByteArray &data) const;
+    QByteArray decompress(const QByteArray &data) const;
+    qint64 decompressedSize(const QByteArray &data) const;
+
+private:
+    int level;
+};
+
+#endif // RPCCOMPRESSOR_H
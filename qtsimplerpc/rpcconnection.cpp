@@ -24,285 +24,2692 @@
 #include "rpcconnection.h"
 #include <QIODevice>
 #include <QDebug>
+#include <QtEndian>
+#include <QTimerEvent>
+#include <string.h>
 #include <QtConcurrentRun>
-#include "rpccommandmapper.h"
+#include <QThreadPool>
+#include <QThread>
+#include <QRunnable>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QCoreApplication>
+#include <QAbstractSocket>
+#include <QLocalSocket>
 #include "rpcsignalmapper.h"
+#include "rpccodec.h"
+#include "rpccompressor.h"
+#include "rpcexecutor.h"
+#include "rpcdeferredreply.h"
+#include <limits.h>
 #include "qjson.h"
 
 
 #define MESSAGE_DELIM "\n"
+#define FRAME_HEADER_SIZE 10
+#define READ_BUFFER_SIZE 4096
+#define MAX_IDLE_READ_BUFFER_SIZE 65536
+#define DEFAULT_WRITE_BUFFER_THRESHOLD 65536
+#define DEFAULT_COMPRESSION_THRESHOLD 1024
+#define DEFAULT_MAXIMUM_MESSAGE_SIZE (64 * 1024 * 1024)
+//! Messages are never buffered beyond this, even without a maximum message size
+#define MAX_BUFFERED_MESSAGE_SIZE (INT_MAX / 2)
+//! Command lines growing beyond this are decoded while they arrive
+#define STREAM_DECODE_THRESHOLD 65536
+//! The head of a streamed command ([#id ][async ][~t ][^w ]name) has to fit into this
+#define MAX_STREAMED_HEAD_SIZE 1024
+#define DEFAULT_HIGH_WATERMARK (4 * 1024 * 1024)
+#define DEFAULT_LOW_WATERMARK (1024 * 1024)
+#define MAX_SIGNAL_BLOCK_TIME 1000
+//! Marks internal IDs of untagged commands, which are answered without request ID
+#define UNTAGGED_RESPONSE_ID 0x80000000u
 
+/*
+  Line protocol (LineFraming):
+    command:        [#<request id> ][~<timeout> ][^<window> ]<command name> <JSON arguments>
+    async command:  async <command name> <JSON arguments>
+    batch:          [#<request id> ]* [~<timeout> ]<JSON list of [<command name>, <arguments>]>
+    async batch:    async * <JSON list of [<command name>, <arguments>]>
+    response:       <error code> [#<request id> ]<JSON result>
+    stream chunk:   + #<request id> <JSON chunk>
+    control:        !<name> <value>
 
-RpcConnection::RpcConnection(QObject *parent) :
+  A response carries the request ID of the command it answers, so any number
+  of calls can be in flight and answered in any order. Each peer announces
+  that it understands request IDs with the control message "tagging on" as
+  the first message on a new device. Peers which don't (older versions)
+  answer it, like any control message, with the untagged parse error
+  "Error parsing command: !<name> <value>", which resolves no call. Until the announcement has arrived,
+  and for peers which don't understand request IDs, commands are sent
+  without request ID (and without timeout or window), and their untagged
+  responses arrive in order: each resolves the oldest untagged call.
+  Untagged commands are likewise answered in the order they arrived, even
+  when they reply deferred. Request IDs are below 2^31.
+
+  Asynchronous commands are never answered. A batch is answered with a
+  single response holding a list of [<error code>, <result>] for the calls
+  in the batch; an async batch isn't answered and its commands run one
+  after another. The optional timeout (in msecs) tells how long the caller
+  is going to wait; a caller giving up early sends the control message
+  "cancel <request id>".
+
+  A command with a window reads streams: a streaming command answers it
+  with chunks followed by the response ending the stream. At most <window>
+  chunks are sent until the caller grants more with the control message
+  "credit <request id> <chunks>". Callers without a window get a streaming
+  command's chunks as a list in the response.
+
+  Binary protocol (BinaryFraming), all integers big endian:
+    header:         quint32 payload length, quint8 message type,
+                    quint8 flags, quint32 request ID
+    payload:        [~<timeout> ][^<window> ]<command name> <arguments> (commands)
+                    [~<timeout> ]<batch> (batches)
+                    <batch> (async batches)
+                    <error code> <result> (responses)
+                    <chunk> (stream chunks)
+                    <name> <value> (control messages)
+    flags:          0x01: arguments / result use the negotiated codec
+                    0x02: payload is compressed with the negotiated compressor
+
+  The framing is switched by the control message "framing binary" or
+  "framing line". Everything following this message is framed the new way.
+  The peer acknowledges with the same message (still using the old framing)
+  and then switches its outgoing framing, too. A peer which doesn't accept
+  binary framing answers "framing line" instead and keeps its framing; the
+  requesting peer then switches back with "framing line", which is
+  acknowledged as usual. Line framing is always accepted.
+
+  The codec is negotiated with the control message "codec <name>". The peer
+  answers with the same message if it accepts, or with "codec json" if it
+  doesn't know or accept the codec. The requesting peer doesn't use any codec between
+  its request and the answer, the answering peer switches right after its
+  answer. As every frame tells whether it uses the codec, frames which were
+  already in flight are still decoded correctly. Line framing always uses JSON.
+
+  Compression is negotiated the same way with "compression <name>", where
+  "none" rejects or disables compression. Peers only accept framing modes,
+  codecs and compressors they were told to accept, or use themselves.
+
+  A peer which only wants to forward signals somebody handles sends the
+  control message "subscriptions". It's answered with "subscribe <names>"
+  listing all mapped commands (space separated). Later changes are sent
+  with "subscribe <names>" and "unsubscribe <names>".
+*/
+
+
+struct RpcConnection::StreamedCommand
+{
+    //! Internal ID for untagged commands, 0 for asynchronous ones
+    quint32 requestId;
+    bool async;
+    QByteArray commandName;
+    int timeout;
+    int streamWindow;
+    //! Bytes received so far, and the head of the line for error messages
+    qint64 size;
+    QByteArray head;
+    RpcJsonStreamDecoder decoder;
+};
+
+//! Shared by a connection and the commands it runs in parallel, which may
+//! outlive it. All members are guarded by the mutex.
+struct RpcResponseChannel
+{
+    QMutex mutex;
+    QWaitCondition jobFinished;
+    //! 0 once the connection is gone
+    RpcConnection *connection;
+    int runningJobs;
+    //! Requests waiting for a worker, and the ones of these canceled by the caller
+    QSet<quint32> queuedRequests;
+    QSet<quint32> canceledRequests;
+
+    RpcResponseChannel(RpcConnection *connection) : connection(connection), runningJobs(0) {}
+};
+
+//! A command run on the thread pool. Posts itself back to the connection
+//! when done, which answers it.
+class RpcCommandJob : public QRunnable
+{
+public:
+    QSharedPointer<RpcResponseChannel> channel;
+    RpcCommandMapper *commandMapper;
+    quint32 requestId;
+    QByteArray commandName;
+    QVariantList arguments;
+    //! Asynchronous commands aren't answered
+    bool async;
+    //! Started once the ordered job before it has finished (ordered
+    //! commands and the commands of an asynchronous batch)
+    bool ordered;
+    //! Credit window of a caller reading streams, 0 if it doesn't
+    int streamWindow;
+    //! Caller's timeout and time since the command has been received
+    int timeout;
+    QElapsedTimer received;
+    //! Canceled or timed out before it ran, nobody waits for an answer
+    bool skipped;
+    RpcCommandMapper::CommandResult result;
+    //! Cacheable commands store their encoded response under this key
+    QByteArray cacheKey;
+
+    RpcCommandJob(const QSharedPointer<RpcResponseChannel> &channel, RpcCommandMapper *commandMapper, quint32 requestId,
+                  const QByteArray &commandName, const QVariantList &arguments, int timeout) :
+        channel(channel), commandMapper(commandMapper), requestId(requestId), commandName(commandName),
+        arguments(arguments), async(false), ordered(false), streamWindow(0), timeout(timeout), skipped(false)
+    {
+        received.start();
+        setAutoDelete(false);
+    }
+
+    void run();
+};
+
+class RpcCommandFinishedEvent : public QEvent
+{
+public:
+    static const QEvent::Type eventType;
+
+    RpcCommandJob *job;
+
+    RpcCommandFinishedEvent(RpcCommandJob *job) : QEvent(eventType), job(job) {}
+    ~RpcCommandFinishedEvent() { delete job; }
+};
+
+const QEvent::Type RpcCommandFinishedEvent::eventType = QEvent::Type(QEvent::registerEventType());
+
+//! Answers a deferred command through the response channel, from any thread
+class RpcDeferredResponse : public RpcDeferredReplyTarget
+{
+public:
+    class Event : public QEvent
+    {
+    public:
+        static const QEvent::Type eventType;
+
+        quint32 requestId;
+        bool successful;
+        QVariant result;
+
+        Event(quint32 requestId, bool successful, const QVariant &result) :
+            QEvent(eventType), requestId(requestId), successful(successful), result(result) {}
+    };
+
+    RpcDeferredResponse(const QSharedPointer<RpcResponseChannel> &channel, quint32 requestId) :
+        channel(channel), requestId(requestId) {}
+
+    void deliver(bool successful, const QVariant &result)
+    {
+        QMutexLocker locker(&channel->mutex);
+        if(channel->connection)
+            QCoreApplication::postEvent(channel->connection, new Event(requestId, successful, result));
+    }
+
+private:
+    QSharedPointer<RpcResponseChannel> channel;
+    quint32 requestId;
+};
+
+const QEvent::Type RpcDeferredResponse::Event::eventType = QEvent::Type(QEvent::registerEventType());
+
+//! Tells the connection about chunks of a stream ready to be sent, from any thread
+class RpcStreamResponse : public RpcStreamTarget
+{
+public:
+    class Event : public QEvent
+    {
+    public:
+        static const QEvent::Type eventType;
+
+        quint32 requestId;
+
+        Event(quint32 requestId) : QEvent(eventType), requestId(requestId) {}
+    };
+
+    RpcStreamResponse(const QSharedPointer<RpcResponseChannel> &channel, quint32 requestId) :
+        channel(channel), requestId(requestId) {}
+
+    void streamReady()
+    {
+        QMutexLocker locker(&channel->mutex);
+        if(channel->connection)
+            QCoreApplication::postEvent(channel->connection, new Event(requestId));
+    }
+
+private:
+    QSharedPointer<RpcResponseChannel> channel;
+    quint32 requestId;
+};
+
+const QEvent::Type RpcStreamResponse::Event::eventType = QEvent::Type(QEvent::registerEventType());
+
+//! Resumes reading once the executor's queue has room, from any thread
+class RpcReadResumer : public RpcExecutorListener
+{
+public:
+    class Event : public QEvent
+    {
+    public:
+        static const QEvent::Type eventType;
+
+        Event() : QEvent(eventType) {}
+    };
+
+    RpcReadResumer(const QSharedPointer<RpcResponseChannel> &channel) : channel(channel) {}
+
+    void queueNotFull()
+    {
+        QMutexLocker locker(&channel->mutex);
+        if(channel->connection)
+            QCoreApplication::postEvent(channel->connection, new Event);
+    }
+
+private:
+    QSharedPointer<RpcResponseChannel> channel;
+};
+
+const QEvent::Type RpcReadResumer::Event::eventType = QEvent::Type(QEvent::registerEventType());
+
+void RpcCommandJob::run()
+{
+    {
+        QMutexLocker locker(&channel->mutex);
+        channel->queuedRequests.remove(requestId);
+        skipped = channel->canceledRequests.remove(requestId);
+        if(!channel->connection) {
+            // the connection (maybe owning the mapper) is gone
+            locker.unlock();
+            delete this;
+            return;
+        }
+        ++channel->runningJobs;
+    }
+
+    if(timeout > 0 && received.hasExpired(timeout))
+        skipped = true;
+    if(!skipped)
+        result = commandMapper->runCommand(commandName, arguments);
+
+    QMutexLocker locker(&channel->mutex);
+    --channel->runningJobs;
+    channel->jobFinished.wakeAll();
+    // ordered jobs are reported even if asynchronous, so the next one can start
+    if(channel->connection && (!async || ordered))
+        QCoreApplication::postEvent(channel->connection, new RpcCommandFinishedEvent(this));
+    else {
+        locker.unlock();
+        delete this;
+    }
+}
+
+
+RpcConnection::RpcConnection(QObject *parent, RpcCommandMapper *sharedCommandMapper) :
     QObject(parent),
-    device(NULL),
-    commandMapper(new RpcCommandMapper(this)),
-    signalMapper(new RpcSignalMapper(this))
+    device(0),
+    readPos(0),
+    readEnd(0),
+    scanPos(0),
+    maxMessageSize(DEFAULT_MAXIMUM_MESSAGE_SIZE),
+    maxIdleReadBufferSize(MAX_IDLE_READ_BUFFER_SIZE),
+    skipFrameBytes(0),
+    skipLine(false),
+    streamedCommand(0),
+    readFraming(LineFraming),
+    writeFraming(LineFraming),
+    framingRequested(false),
+    binaryFramingAccepted(false),
+    readCodec(0),
+    writeCodec(0),
+    requestedCodec(0),
+    readCompressor(0),
+    writeCompressor(0),
+    compressionThreshold(DEFAULT_COMPRESSION_THRESHOLD),
+    flushDelay(0),
+    flushThreshold(DEFAULT_WRITE_BUFFER_THRESHOLD),
+    highWatermark(DEFAULT_HIGH_WATERMARK),
+    lowWatermark(DEFAULT_LOW_WATERMARK),
+    writeCongested(false),
+    congestionPolicy(ConflateSignals),
+    signalBatchDelay(-1),
+    signalSubscription(false),
+    peerWantsSubscriptions(false),
+    commandMapper(sharedCommandMapper ? sharedCommandMapper : new RpcCommandMapper(this)),
+    ownCommandMapper(!sharedCommandMapper),
+    signalMapper(0),
+    parallelDispatch(false),
+    commandExecutor(0),
+    threadAffineDispatch(false),
+    orderedJobRunning(false),
+    readPaused(false),
+    pausedReadBufferSize(0),
+    nextRequestId(1),
+    peerTagging(TaggingUnknown),
+    hadPeerDevice(false),
+    nextUntaggedResponseId(0),
+    defaultTimeout(0),
+    resultCache(0),
+    cacheGeneration(0)
+{
+    clock.start();
+}
+
+RpcConnection::~RpcConnection()
+{
+    // collected messages were written right away before coalescing, keep delivering them
+    sendSignalBatch();
+    flushNow();
+
+    // synchronous calls are owned by their waiters, all others are ours
+    foreach(PendingCall *call, pendingCalls)
+    {
+        if(call->loop)
+            continue;
+        if(call->hasFuture) {
+            call->future.reportCanceled();
+            call->future.reportFinished();
+        }
+        delete call;
+    }
+
+    // wake up stream writers waiting for credit
+    foreach(OutgoingStream stream, outgoingStreams)
+        stream.writer.cancel();
+
+    delete streamedCommand;
+
+    // commands still waiting for a worker are dropped, running ones may use the mapper
+    qDeleteAll(orderedJobs);
+    if(responseChannel)
+    {
+        QMutexLocker locker(&responseChannel->mutex);
+        responseChannel->connection = 0;
+        while(responseChannel->runningJobs)
+            responseChannel->jobFinished.wait(&responseChannel->mutex);
+    }
+}
+
+void RpcConnection::setPeerDevice(QIODevice *peerDevice)
+{
+    if(device) {
+        flushNow();
+        device->disconnect(this);
+    }
+
+    // the old peer won't answer anymore, and answers meant for it must not
+    // reach the new one; only messages queued before the first device are kept
+    QList<quint32> abandonedCalls;
+    if(hadPeerDevice)
+    {
+        writeBuf.clear();
+        untaggedCalls.clear();
+        untaggedResponseOrder.clear();
+        heldUntaggedResponses.clear();
+        foreach(OutgoingStream stream, outgoingStreams)
+            stream.writer.cancel();
+        outgoingStreams.clear();
+        abandonedCalls = pendingCalls.keys();
+
+        // the new peer starts with a fresh stream in line framing
+        readPos = readEnd = scanPos = 0;
+        skipFrameBytes = 0;
+        skipLine = false;
+        delete streamedCommand;
+        streamedCommand = 0;
+        readFraming = writeFraming = LineFraming;
+        framingRequested = false;
+        readCodec = writeCodec = requestedCodec = 0;
+        readCompressor = writeCompressor = 0;
+        requestedCompression.clear();
+        peerWantsSubscriptions = false;
+    }
+
+    device = peerDevice;
+    if(device) {
+        hadPeerDevice = true;
+        connect(device, SIGNAL(readyRead()), SLOT(device_readyRead()));
+        connect(device, SIGNAL(bytesWritten(qint64)), SLOT(device_bytesWritten()));
+
+        // announce before the queued messages
+        peerTagging = TaggingUnknown;
+        QByteArray queued = writeBuf;
+        writeBuf.clear();
+        sendControlMessage("tagging", "on");
+        writeBuf += queued;
+    }
+
+    // callbacks may call again, which goes to the new device
+    foreach(quint32 requestId, abandonedCalls)
+    {
+        PendingCall *call = pendingCalls.contains(requestId) ? takePendingCall(requestId) : 0;
+        if(call)
+            completeCall(call, CanceledError, QVariant("Peer device changed"));
+    }
+}
+
+QIODevice *RpcConnection::peerDevice() const
+{
+    return device;
+}
+
+void RpcConnection::setFramingMode(FramingMode mode)
+{
+    if(mode == writeFraming)
+        return;
+    if(!device) {
+        qWarning("Can't change framing mode without peer device.");
+        return;
+    }
+    if(deferNegotiation("framing", mode == BinaryFraming ? "binary" : "line"))
+        return;
+
+    // announce using the old framing; the peer's acknowledgement switches our reader
+    sendControlMessage("framing", mode == BinaryFraming ? "binary" : "line");
+    writeFraming = mode;
+    framingRequested = true;
+    if(mode == BinaryFraming)
+        binaryFramingAccepted = true;
+}
+
+RpcConnection::FramingMode RpcConnection::framingMode() const
+{
+    return writeFraming;
+}
+
+void RpcConnection::setCodec(const QByteArray &codecName)
+{
+    RpcCodec *codec = RpcCodec::codec(codecName);
+    if(!codec) {
+        qWarning("Can't use codec \"%s\": no such codec.", codecName.constData());
+        return;
+    }
+    if(deferNegotiation("codec", codec->name()))
+        return;
+    if(codec->isBinary() && writeFraming != BinaryFraming) {
+        qWarning("Can't use codec \"%s\" without binary framing.", codecName.constData());
+        return;
+    }
+    if(!device) {
+        qWarning("Can't negotiate codec without peer device.");
+        return;
+    }
+
+    // use JSON until the peer answers
+    acceptedCodecs.insert(codec->name());
+    requestedCodec = codec;
+    writeCodec = 0;
+    sendControlMessage("codec", codec->name());
+}
+
+QByteArray RpcConnection::codec() const
+{
+    return writeCodec ? writeCodec->name() : RpcCodec::defaultCodec()->name();
+}
+
+void RpcConnection::setCompression(const QByteArray &compressorName, int threshold)
+{
+    if(compressorName != "none" && !RpcCompressor::compressor(compressorName)) {
+        qWarning("Can't use compressor \"%s\": no such compressor.", compressorName.constData());
+        return;
+    }
+    compressionThreshold = qMax(threshold, 0);
+    if(deferNegotiation("compression", compressorName))
+        return;
+    if(writeFraming != BinaryFraming) {
+        qWarning("Can't use compression without binary framing.");
+        return;
+    }
+
+    // don't compress until the peer answers
+    acceptedCompressors.insert(compressorName);
+    requestedCompression = compressorName;
+    writeCompressor = 0;
+    sendControlMessage("compression", compressorName);
+}
+
+QByteArray RpcConnection::compression() const
+{
+    return writeCompressor ? writeCompressor->name() : QByteArray("none");
+}
+
+void RpcConnection::setBinaryFramingAccepted(bool accepted)
+{
+    binaryFramingAccepted = accepted;
+}
+
+void RpcConnection::setCodecAccepted(const QByteArray &codecName, bool accepted)
+{
+    if(accepted)
+        acceptedCodecs.insert(codecName);
+    else
+        acceptedCodecs.remove(codecName);
+}
+
+void RpcConnection::setCompressionAccepted(const QByteArray &compressorName, bool accepted)
+{
+    if(accepted)
+        acceptedCompressors.insert(compressorName);
+    else
+        acceptedCompressors.remove(compressorName);
+}
+
+void RpcConnection::setMaximumMessageSize(int bytes)
+{
+    maxMessageSize = qMax(bytes, 0);
+}
+
+int RpcConnection::maximumMessageSize() const
+{
+    return maxMessageSize;
+}
+
+void RpcConnection::setMaximumIdleReadBufferSize(int bytes)
+{
+    maxIdleReadBufferSize = qMax(bytes, 0);
+}
+
+void RpcConnection::setWriteCoalescingDelay(int msec)
+{
+    flushDelay = qMax(msec, 0);
+}
+
+int RpcConnection::writeCoalescingDelay() const
+{
+    return flushDelay;
+}
+
+void RpcConnection::setWriteBufferThreshold(int bytes)
+{
+    flushThreshold = qMax(bytes, 0);
+}
+
+int RpcConnection::writeBufferThreshold() const
+{
+    return flushThreshold;
+}
+
+void RpcConnection::setWriteWatermarks(int high, int low)
+{
+    highWatermark = qMax(high, 0);
+    lowWatermark = qBound(0, low, highWatermark);
+    updateCongestion();
+}
+
+bool RpcConnection::isCongested() const
+{
+    return writeCongested;
+}
+
+void RpcConnection::setSignalCongestionPolicy(SignalCongestionPolicy policy)
+{
+    congestionPolicy = policy;
+}
+
+RpcConnection::SignalCongestionPolicy RpcConnection::signalCongestionPolicy() const
+{
+    return congestionPolicy;
+}
+
+qint64 RpcConnection::pendingWriteSize() const
+{
+    return writeBuf.size() + (device ? device->bytesToWrite() : 0);
+}
+
+void RpcConnection::updateCongestion()
+{
+    if(!writeCongested && highWatermark && pendingWriteSize() >= highWatermark)
+    {
+        writeCongested = true;
+        emit congested();
+    }
+    else if(writeCongested && (!highWatermark || pendingWriteSize() <= lowWatermark))
+    {
+        writeCongested = false;
+        emit drained();
+
+        // forward conflated signals with their latest arguments, until sending
+        // them makes the connection congested again
+        while(!writeCongested && !conflatedSignalOrder.isEmpty())
+        {
+            QByteArray command = conflatedSignalOrder.takeFirst();
+            sendForwardedSignal(command, conflatedSignals.take(command));
+        }
+    }
+}
+
+void RpcConnection::device_bytesWritten()
+{
+    updateCongestion();
+}
+
+void RpcConnection::forwardSignal(QByteArray command, QVariantList arguments)
+{
+    if(writeCongested)
+    {
+        switch(congestionPolicy)
+        {
+        case(DropSignals):
+            return;
+        case(BlockSignals):
+        {
+            // write synchronously until drained, device_bytesWritten() updates the state;
+            // a stalled peer or a device which can't wait mustn't freeze us
+            flushNow();
+            QElapsedTimer blocked;
+            blocked.start();
+            while(writeCongested && device)
+            {
+                int remaining = MAX_SIGNAL_BLOCK_TIME - int(blocked.elapsed());
+                if(remaining <= 0 || !device->waitForBytesWritten(remaining))
+                    break;
+            }
+            if(!writeCongested)
+                break;
+            conflateSignal(command, arguments);
+            return;
+        }
+        case(ConflateSignals):
+            conflateSignal(command, arguments);
+            return;
+        }
+    }
+    sendForwardedSignal(command, arguments);
+}
+
+void RpcConnection::conflateSignal(const QByteArray &command, const QVariantList &arguments)
+{
+    if(!conflatedSignals.contains(command))
+        conflatedSignalOrder << command;
+    conflatedSignals.insert(command, arguments);
+}
+
+void RpcConnection::setSignalBatchWindow(int msec)
+{
+    signalBatchDelay = qMax(msec, -1);
+    if(signalBatchDelay == -1)
+        sendSignalBatch();
+}
+
+int RpcConnection::signalBatchWindow() const
+{
+    return signalBatchDelay;
+}
+
+void RpcConnection::flushNow()
+{
+    flushTimer.stop();
+    if(writeBuf.isEmpty() || !device)
+        return;
+
+    device->write(writeBuf);
+    writeBuf.clear();
+    emit deviceFlush();
+}
+
+bool RpcConnection::event(QEvent *event)
+{
+    if(event->type() == RpcDeferredResponse::Event::eventType)
+    {
+        RpcDeferredResponse::Event *response = static_cast<RpcDeferredResponse::Event *>(event);
+        sendResponse(response->requestId, response->successful ? NoError : SystemError, response->result);
+        return true;
+    }
+    if(event->type() == RpcStreamResponse::Event::eventType)
+    {
+        sendStreamChunks(static_cast<RpcStreamResponse::Event *>(event)->requestId);
+        return true;
+    }
+    if(event->type() == RpcReadResumer::Event::eventType)
+    {
+        resumeReading();
+        return true;
+    }
+    if(event->type() != RpcCommandFinishedEvent::eventType)
+        return QObject::event(event);
+
+    RpcCommandJob *job = static_cast<RpcCommandFinishedEvent *>(event)->job;
+    if(!job->async && job->skipped && (job->requestId & UNTAGGED_RESPONSE_ID))
+        // untagged answers after this one wait for it
+        sendResponse(job->requestId, TimeoutError, QVariant("Call timed out"));
+    else if(!job->async && !job->skipped && !deferResponse(job->requestId, job->result, job->streamWindow))
+        sendCommandResponse(job->requestId, job->commandName, job->result, job->cacheKey);
+    if(job->ordered)
+        startNextOrderedJob();
+    return true;
+}
+
+void RpcConnection::timerEvent(QTimerEvent *event)
+{
+    if(event->timerId() == flushTimer.timerId())
+        flushNow();
+    else if(event->timerId() == signalBatchTimer.timerId())
+        sendSignalBatch();
+    else if(event->timerId() == timeoutTimer.timerId())
+        expireCalls();
+    else
+        QObject::timerEvent(event);
+}
+
+RpcCodec *RpcConnection::outgoingCodec(quint8 *flags) const
+{
+    if(writeFraming == BinaryFraming && writeCodec) {
+        *flags |= CodecFrameFlag;
+        return writeCodec;
+    }
+    return RpcCodec::defaultCodec();
+}
+
+RpcCodec *RpcConnection::incomingCodec(quint8 flags) const
+{
+    if((flags & CodecFrameFlag) && readCodec)
+        return readCodec;
+    return RpcCodec::defaultCodec();
+}
+
+void RpcConnection::mapCommandToSlot(const QByteArray &commandName, QObject *object, const char *member)
+{
+    if(!ownCommandMapper) {
+        qWarning("Can't map commands on a connection sharing its commands! Ignoring.");
+        return;
+    }
+    commandMapper->addMapping(commandName, object, member);
+    if(peerWantsSubscriptions)
+        subscribeCommand(commandName);
+}
+
+void RpcConnection::mapAllCommandsToSlots(QObject *object)
+{
+    if(!ownCommandMapper) {
+        qWarning("Can't map commands on a connection sharing its commands! Ignoring.");
+        return;
+    }
+    commandMapper->addAllMappings(object);
+    if(peerWantsSubscriptions)
+        announceSubscriptions();
+}
+
+void RpcConnection::mapSignalToCommand(QObject *object, const char *signal, const QByteArray &commandName)
+{
+    // created on demand, most server side connections never forward signals
+    if(!signalMapper)
+    {
+        signalMapper = new RpcSignalMapper(this);
+        connect(signalMapper, SIGNAL(mappedCommand(QByteArray,QVariantList)),
+                SLOT(remoteCall(QByteArray,QVariantList)));
+        connect(signalMapper, SIGNAL(mappedCommandAsync(QByteArray,QVariantList)),
+                SLOT(forwardSignal(QByteArray,QVariantList)));
+    }
+    signalMapper->addMapping(object, signal, commandName);
+    if(signalSubscription)
+        signalMapper->setCommandEnabled(commandName, subscribedCommands.contains(commandName));
+}
+
+void RpcConnection::setSignalSubscriptionEnabled(bool enabled)
+{
+    if(signalSubscription == enabled)
+        return;
+    signalSubscription = enabled;
+    subscribedCommands.clear();
+    if(signalMapper)
+        signalMapper->setAllCommandsEnabled(!enabled);
+    if(enabled && !deferNegotiation("subscriptions", QByteArray()))
+        sendControlMessage("subscriptions", QByteArray());
+}
+
+bool RpcConnection::isSignalSubscriptionEnabled() const
+{
+    return signalSubscription;
+}
+
+void RpcConnection::subscribeCommand(const QByteArray &commandName)
+{
+    if(peerWantsSubscriptions)
+        sendControlMessage("subscribe", commandName);
+}
+
+void RpcConnection::unsubscribeCommand(const QByteArray &commandName)
+{
+    if(peerWantsSubscriptions)
+        sendControlMessage("unsubscribe", commandName);
+}
+
+bool RpcConnection::deferNegotiation(const QByteArray &name, const QByteArray &value)
+{
+    // older peers answer control messages with errors, and can't switch
+    // framing or codecs; wait until the peer has announced itself
+    switch(peerTagging)
+    {
+    case(TaggingSupported):
+        return false;
+    case(TaggingUnknown):
+        deferredNegotiation << qMakePair(name, value);
+        return true;
+    default:
+        qWarning("Peer doesn't support control messages, can't request \"%s\"! Ignoring.", name.constData());
+        if(name == "subscriptions")
+            setSignalSubscriptionEnabled(false);
+        return true;
+    }
+}
+
+void RpcConnection::setPeerTagging(PeerTagging tagging)
+{
+    if(peerTagging != TaggingUnknown || tagging == TaggingUnknown)
+        return;
+    peerTagging = tagging;
+
+    // requests made while we didn't know are sent now, or dropped for older peers
+    QList<QPair<QByteArray, QByteArray> > requests = deferredNegotiation;
+    deferredNegotiation.clear();
+    for(int i = 0; i < requests.count(); ++i)
+    {
+        const QByteArray &name = requests.at(i).first;
+        const QByteArray &value = requests.at(i).second;
+        if(name == "framing")
+            setFramingMode(value == "binary" ? BinaryFraming : LineFraming);
+        else if(name == "codec")
+            setCodec(value);
+        else if(name == "compression")
+            setCompression(value, compressionThreshold);
+        else if(name == "subscriptions" && signalSubscription && !deferNegotiation(name, value))
+            sendControlMessage(name, value);
+    }
+}
+
+void RpcConnection::announceSubscriptions()
+{
+    QByteArray commandNames;
+    foreach(QByteArray commandName, commandMapper->listOfCommands())
+        commandNames += (commandNames.isEmpty() ? "" : " ") + commandName;
+    sendControlMessage("subscribe", commandNames);
+}
+
+void RpcConnection::setSignalConflationWindow(QObject *object, const char *signal, int window, int keyArgument)
+{
+    if(!signalMapper) {
+        qWarning("No signals are mapped! Ignoring.");
+        return;
+    }
+    signalMapper->setConflationWindow(object, signal, window, keyArgument);
+}
+
+void RpcConnection::setSignalMinimumInterval(QObject *object, const char *signal, int interval, int keyArgument)
+{
+    if(!signalMapper) {
+        qWarning("No signals are mapped! Ignoring.");
+        return;
+    }
+    signalMapper->setMinimumInterval(object, signal, interval, keyArgument);
+}
+
+void RpcConnection::mapAllSignalsToCommands(QObject *object)
+{
+    const QMetaObject *mo = object->metaObject();
+    // skip QObject's members
+    for(int i = QObject::staticMetaObject.methodCount(); i < mo->methodCount(); ++i)
+    {
+        if(mo->method(i).methodType() == QMetaMethod::Signal)
+        {
+            //qDebug("Found signal: %s", mo->method(i).signature());
+            QByteArray commandName = mo->method(i).signature();
+            commandName = commandName.left(commandName.indexOf('(')); // remove arguments to get command name
+            mapSignalToCommand(object, mo->method(i).signature(), commandName);
+        }
+    }
+}
+
+QVariant RpcConnection::remoteCall(QByteArray command, QVariantList arguments, int *errorCode, int timeout)
+{
+    QByteArray cacheKey = resultCacheKey(command, arguments);
+    QVariant cached;
+    if(findCachedResult(cacheKey, &cached)) {
+        if(errorCode)
+            *errorCode = NoError;
+        return cached;
+    }
+
+    QEventLoop loop;
+    PendingCall call;
+    call.loop = &loop;
+    call.cacheKey = cacheKey;
+    call.cacheGeneration = cacheGeneration;
+
+    quint32 requestId = registerCall(&call, timeout);
+    sendCommand(requestId, command, arguments, effectiveTimeout(timeout));
+    flushNow(); // we are going to wait anyway
+    QVariant response = waitForResponse(&call, errorCode);
+    return response;
+}
+
+QVariantList RpcConnection::remoteCallBatch(QList<QPair<QByteArray, QVariantList> > calls, QList<int> *errorCodes, int timeout)
+{
+    QVariantList batch;
+    for(int i = 0; i < calls.count(); ++i)
+        batch << QVariant(QVariantList() << QString::fromUtf8(calls.at(i).first) << QVariant(calls.at(i).second));
+
+    QEventLoop loop;
+    PendingCall call;
+    call.loop = &loop;
+
+    quint32 requestId = registerCall(&call, timeout);
+    sendBatch(requestId, batch, effectiveTimeout(timeout));
+    flushNow(); // we are going to wait anyway
+    int errorCode;
+    QVariant response = waitForResponse(&call, &errorCode);
+
+    QVariantList results;
+    if(errorCodes)
+        errorCodes->clear();
+    QVariantList entries = response.toList();
+    if(errorCode != NoError || response.type() != QVariant::List || entries.count() != calls.count())
+    {
+        // the batch as a whole failed, so each call did
+        if(errorCode == NoError)
+            errorCode = ParseError;
+        for(int i = 0; i < calls.count(); ++i) {
+            results << response;
+            if(errorCodes)
+                *errorCodes << errorCode;
+        }
+        return results;
+    }
+
+    foreach(QVariant entry, entries)
+    {
+        QVariantList codeAndResult = entry.toList();
+        results << codeAndResult.value(1);
+        if(errorCodes)
+            *errorCodes << (codeAndResult.count() == 2 ? codeAndResult.at(0).toInt() : int(ParseError));
+    }
+    return results;
+}
+
+void RpcConnection::remoteCallAsync(QByteArray command, QVariantList arguments)
+{
+    sendCommandAsync(command, arguments);
+}
+
+QFuture<QVariant> RpcConnection::remoteCallFuture(QByteArray command, QVariantList arguments, int timeout, quint32 *requestId)
+{
+    QByteArray cacheKey = resultCacheKey(command, arguments);
+    QVariant cached;
+    if(findCachedResult(cacheKey, &cached))
+    {
+        QFutureInterface<QVariant> finished;
+        finished.reportStarted();
+        finished.reportResult(cached);
+        finished.reportFinished();
+        if(requestId)
+            *requestId = 0;
+        return finished.future();
+    }
+
+    PendingCall *call = new PendingCall;
+    call->hasFuture = true;
+    call->future.reportStarted();
+    call->cacheKey = cacheKey;
+    call->cacheGeneration = cacheGeneration;
+    QFuture<QVariant> future = call->future.future();
+
+    quint32 id = registerCall(call, timeout);
+    if(requestId)
+        *requestId = id;
+    sendCommand(id, command, arguments, effectiveTimeout(timeout));
+    return future;
+}
+
+quint32 RpcConnection::remoteCallWithCallback(QByteArray command, QVariantList arguments, QObject *receiver, const char *member, int timeout)
+{
+    QByteArray cacheKey = resultCacheKey(command, arguments);
+    QVariant cached;
+    if(findCachedResult(cacheKey, &cached))
+    {
+        // still call back later, like for a response
+        QMetaObject::invokeMethod(receiver, methodName(member).constData(), Qt::QueuedConnection,
+                                  Q_ARG(QVariant, cached), Q_ARG(int, int(NoError)));
+        return 0;
+    }
+
+    PendingCall *call = new PendingCall;
+    call->receiver = receiver;
+    call->member = methodName(member);
+    call->cacheKey = cacheKey;
+    call->cacheGeneration = cacheGeneration;
+
+    quint32 requestId = registerCall(call, timeout);
+    sendCommand(requestId, command, arguments, effectiveTimeout(timeout));
+    return requestId;
+}
+
+quint32 RpcConnection::remoteCallStream(QByteArray command, QVariantList arguments, QObject *receiver,
+                                        const char *chunkMember, const char *finishedMember, int window, int timeout)
+{
+    PendingCall *call = new PendingCall;
+    call->receiver = receiver;
+    call->member = methodName(finishedMember);
+    call->chunkMember = methodName(chunkMember);
+    call->streamWindow = qMax(window, 1);
+
+    quint32 requestId = registerCall(call, timeout);
+    sendCommand(requestId, command, arguments, effectiveTimeout(timeout), call->streamWindow);
+    return requestId;
+}
+
+void RpcConnection::setDefaultCallTimeout(int msec)
+{
+    defaultTimeout = qMax(msec, 0);
+}
+
+int RpcConnection::defaultCallTimeout() const
+{
+    return defaultTimeout;
+}
+
+void RpcConnection::setParallelDispatchEnabled(bool enabled)
+{
+    parallelDispatch = enabled;
+    if(enabled)
+        ensureResponseChannel();
+}
+
+bool RpcConnection::isParallelDispatchEnabled() const
+{
+    return parallelDispatch;
+}
+
+void RpcConnection::setCommandOrdered(const QByteArray &commandName, bool ordered)
+{
+    if(!ownCommandMapper) {
+        qWarning("Can't change commands on a connection sharing its commands! Ignoring.");
+        return;
+    }
+    commandMapper->setCommandOrdered(commandName, ordered);
+}
+
+void RpcConnection::setCommandResponseCacheable(const QByteArray &commandName, bool cacheable)
+{
+    if(!ownCommandMapper) {
+        qWarning("Can't change commands on a connection sharing its commands! Ignoring.");
+        return;
+    }
+    commandMapper->setCommandResponseCacheable(commandName, cacheable);
+}
+
+void RpcConnection::setResponseCacheSize(int bytes)
+{
+    if(!ownCommandMapper) {
+        qWarning("Can't change commands on a connection sharing its commands! Ignoring.");
+        return;
+    }
+    commandMapper->setResponseCacheSize(bytes);
+}
+
+void RpcConnection::setExecutor(RpcExecutor *executor)
+{
+    commandExecutor = executor;
+}
+
+RpcExecutor *RpcConnection::executor() const
+{
+    return commandExecutor;
+}
+
+void RpcConnection::setThreadAffineDispatchEnabled(bool enabled)
+{
+    threadAffineDispatch = enabled;
+    if(enabled)
+        ensureResponseChannel();
+}
+
+bool RpcConnection::isThreadAffineDispatchEnabled() const
+{
+    return threadAffineDispatch;
+}
+
+void RpcConnection::setResultCacheSize(int entries)
+{
+    resultCache.setMaxCost(qMax(entries, 0));
+}
+
+int RpcConnection::resultCacheSize() const
+{
+    return resultCache.maxCost();
+}
+
+void RpcConnection::setCommandResultCacheable(const QByteArray &commandName, bool cacheable, int ttl)
+{
+    if(cacheable)
+        cacheableCommands.insert(commandName, qMax(ttl, 0));
+    else if(cacheableCommands.remove(commandName))
+        invalidateCachedResults(commandName);
+}
+
+void RpcConnection::setCacheInvalidatedBy(const QByteArray &incomingCommand, const QByteArray &cachedCommand)
+{
+    if(!cacheInvalidations.contains(incomingCommand, cachedCommand))
+        cacheInvalidations.insert(incomingCommand, cachedCommand);
+}
+
+void RpcConnection::invalidateCachedResults(const QByteArray &commandName)
+{
+    // results of calls still on their way may be outdated as well
+    ++cacheGeneration;
+
+    if(commandName.isEmpty()) {
+        resultCache.clear();
+        return;
+    }
+    QByteArray prefix = commandName + ' ';
+    foreach(QByteArray key, resultCache.keys())
+    {
+        if(key.startsWith(prefix))
+            resultCache.remove(key);
+    }
+}
+
+QByteArray RpcConnection::resultCacheKey(const QByteArray &command, const QVariantList &arguments) const
+{
+    if(!resultCache.maxCost() || !cacheableCommands.contains(command))
+        return QByteArray();
+
+    // compact JSON is canonical for equal arguments, as maps are ordered by key
+    QJson::Error jsonError;
+    QString json = QJson::encode(arguments, QJson::EncodeOptions(QJson::Compact), &jsonError);
+    if(!jsonError.isNull())
+        return QByteArray();
+    return command + ' ' + json.toUtf8();
+}
+
+bool RpcConnection::findCachedResult(const QByteArray &key, QVariant *result)
+{
+    if(key.isEmpty())
+        return false;
+
+    CachedResult *cached = resultCache.object(key); // also marks it as recently used
+    if(!cached)
+        return false;
+    if(cached->expiry != -1 && cached->expiry <= clock.elapsed()) {
+        resultCache.remove(key);
+        return false;
+    }
+    *result = cached->result;
+    return true;
+}
+
+void RpcConnection::storeCachedResult(PendingCall *call, const QVariant &result)
+{
+    QByteArray commandName = call->cacheKey.left(call->cacheKey.indexOf(' '));
+    if(call->cacheGeneration != cacheGeneration || !cacheableCommands.contains(commandName))
+        return;
+
+    int ttl = cacheableCommands.value(commandName);
+    CachedResult *cached = new CachedResult;
+    cached->result = result;
+    cached->expiry = ttl ? clock.elapsed() + ttl : -1;
+    resultCache.insert(call->cacheKey, cached);
+}
+
+void RpcConnection::invalidateCachesFor(const QByteArray &incomingCommand)
+{
+    foreach(QByteArray cachedCommand, cacheInvalidations.values(incomingCommand))
+        invalidateCachedResults(cachedCommand);
+}
+
+void RpcConnection::cancelCall(quint32 requestId)
+{
+    PendingCall *call = pendingCalls.contains(requestId) ? takePendingCall(requestId) : 0;
+    if(!call)
+        return;
+
+    // the peer can only skip commands it knows by request ID
+    if(call->tagged)
+        sendControlMessage("cancel", QByteArray::number(requestId));
+    completeCall(call, CanceledError, QVariant("Call canceled"));
+}
+
+void RpcConnection::cancelAllCalls()
+{
+    foreach(quint32 requestId, pendingCalls.keys())
+        cancelCall(requestId);
+}
+
+void RpcConnection::registerEnums(const QMetaObject *metaObject)
+{
+    //qDebug("Registering enums of class %s", metaObject->className());
+    for(int i = QObject::staticMetaObject.enumeratorOffset(); i < metaObject->enumeratorCount(); ++i)
+    {
+        QMetaEnum metaEnum = metaObject->enumerator(i);
+        QByteArray enumTypeName = QByteArray(metaObject->className()) + "::" + metaEnum.name();
+        int enumType = QMetaType::type(enumTypeName.constData());
+        if(enumType)
+            QJson::treatMetaTypeAsInteger(enumType);
+    }
+}
+
+void RpcConnection::device_readyRead()
+{
+    if(readPaused)
+        return;
+
+    // the buffer may stop growing before the device is drained; the
+    // oversized message gets dropped, then reading goes on
+    bool drained;
+    do {
+        drained = fillReadBuffer();
+        processReadBuffer();
+    } while(!drained && !readPaused && device);
+}
+
+void RpcConnection::processReadBuffer()
+{
+    // process one message after another. Each message is consumed before
+    // processing it, as processing may re-enter this slot (nested event loop)
+    // or switch the framing mode of the following messages. For the same
+    // reason, the buffer positions are re-read in every iteration.
+    while(!readPaused)
+    {
+        if(skipFrameBytes)
+        {
+            // drop the rest of an oversized frame as it arrives
+            int skipped = qMin<qint64>(skipFrameBytes, readEnd - readPos);
+            readPos = scanPos = readPos + skipped;
+            skipFrameBytes -= skipped;
+            if(skipFrameBytes)
+                break;
+        }
+        else if(readFraming == BinaryFraming)
+        {
+            if(readEnd - readPos < FRAME_HEADER_SIZE)
+                break;
+            const uchar *header = reinterpret_cast<const uchar *>(readBuf.constData() + readPos);
+            quint32 length = qFromBigEndian<quint32>(header);
+            MessageType type = (MessageType)header[4];
+            quint8 flags = header[5];
+            quint32 requestId = qFromBigEndian<quint32>(header + 6);
+
+            if(length > quint32(messageSizeLimit()))
+            {
+                skipFrameBytes = FRAME_HEADER_SIZE + qint64(length);
+                rejectOversizedMessage(type, requestId);
+                continue;
+            }
+            if(qint64(readEnd - readPos) < FRAME_HEADER_SIZE + qint64(length))
+            {
+                // the header tells how much to wait for, so make room at once
+                reserveReadBuffer(FRAME_HEADER_SIZE + int(length));
+                break;
+            }
+
+            QByteArray payload(readBuf.constData() + readPos + FRAME_HEADER_SIZE, length);
+            readPos += FRAME_HEADER_SIZE + length;
+            scanPos = readPos;
+            processFrame(type, flags, requestId, payload);
+        }
+        else
+        {
+            const char *delim = static_cast<const char *>(
+                        memchr(readBuf.constData() + scanPos, MESSAGE_DELIM[0], readEnd - scanPos));
+            int messageEnd = delim ? delim - readBuf.constData() : readEnd;
+
+            if(streamedCommand)
+            {
+                // hand what has arrived of a large command to its decoder
+                int end = delim ? messageEnd : readEnd;
+                streamedCommand->size += end - readPos;
+                if(streamedCommand->size > messageSizeLimit())
+                {
+                    rejectOversizedMessage(streamedCommand->async ? AsyncCommandMessage : CommandMessage,
+                                           streamedCommand->requestId);
+                    delete streamedCommand;
+                    streamedCommand = 0;
+                    skipLine = true;
+                    continue;
+                }
+                streamedCommand->decoder.feed(readBuf.constData() + readPos, end - readPos);
+                readPos = scanPos = end;
+                if(!delim)
+                    break;
+                readPos = scanPos = messageEnd + 1;
+                finishStreamedCommand();
+                continue;
+            }
+
+            if(!skipLine && messageEnd - readPos > messageSizeLimit())
+            {
+                skipLine = true;
+                rejectOversizedLine(QByteArray(readBuf.constData() + readPos, qMin(messageEnd - readPos, 32)));
+            }
+            if(skipLine)
+            {
+                // drop the oversized line up to the delimiter, without buffering it
+                if(!delim) {
+                    readPos = scanPos = readEnd;
+                    break;
+                }
+                readPos = scanPos = messageEnd + 1;
+                skipLine = false;
+                continue;
+            }
+
+            if(!delim) {
+                // decode large commands while they arrive instead of buffering them
+                if(readEnd - readPos >= STREAM_DECODE_THRESHOLD && startStreamedCommand())
+                    continue;
+                // don't scan the incomplete message again on the next call
+                scanPos = readEnd;
+                break;
+            }
+
+            QByteArray message(readBuf.constData() + readPos, messageEnd - readPos);
+            readPos = scanPos = messageEnd + 1;
+            processRawMessage(message);
+        }
+    }
+
+    // rewind when everything has been processed; drop storage grown by huge messages
+    if(readPos == readEnd)
+    {
+        readPos = readEnd = scanPos = 0;
+        if(readBuf.size() > maxIdleReadBufferSize)
+            readBuf = QByteArray();
+    }
+}
+
+bool RpcConnection::fillReadBuffer()
+{
+    // read straight into the free space at the end of the buffer
+    forever
+    {
+        if(readEnd == readBuf.size())
+        {
+            // make room: reuse the consumed space first, grow only if full,
+            // and not beyond what any message may take
+            if(readPos > 0)
+                compactReadBuffer();
+            else if(readBuf.size() > MAX_BUFFERED_MESSAGE_SIZE)
+                return false;
+            else
+                readBuf.resize(int(qMin(qMax(qint64(readBuf.size()) * 2, qint64(READ_BUFFER_SIZE)),
+                                        qint64(MAX_BUFFERED_MESSAGE_SIZE) + 1)));
+        }
+
+        qint64 bytesRead = device->read(readBuf.data() + readEnd, readBuf.size() - readEnd);
+        if(bytesRead <= 0)
+            return true;
+        readEnd += bytesRead;
+    }
+}
+
+int RpcConnection::messageSizeLimit() const
+{
+    return (maxMessageSize > 0) ? qMin(maxMessageSize, MAX_BUFFERED_MESSAGE_SIZE) : MAX_BUFFERED_MESSAGE_SIZE;
+}
+
+void RpcConnection::pauseReading()
+{
+    // sockets keep reading into their own buffer unless it's limited; once
+    // it's full, the peer can't send any more
+    readPaused = true;
+    if(QAbstractSocket *socket = qobject_cast<QAbstractSocket *>(device)) {
+        pausedReadBufferSize = socket->readBufferSize();
+        socket->setReadBufferSize(READ_BUFFER_SIZE);
+    }
+    else if(QLocalSocket *socket = qobject_cast<QLocalSocket *>(device)) {
+        pausedReadBufferSize = socket->readBufferSize();
+        socket->setReadBufferSize(READ_BUFFER_SIZE);
+    }
+    commandExecutor->notifyWhenNotFull(new RpcReadResumer(responseChannel));
+}
+
+void RpcConnection::resumeReading()
+{
+    if(!readPaused)
+        return;
+    readPaused = false;
+    if(QAbstractSocket *socket = qobject_cast<QAbstractSocket *>(device))
+        socket->setReadBufferSize(pausedReadBufferSize);
+    else if(QLocalSocket *socket = qobject_cast<QLocalSocket *>(device))
+        socket->setReadBufferSize(pausedReadBufferSize);
+
+    // messages buffered meanwhile don't trigger readyRead() again
+    if(device)
+        device_readyRead();
+}
+
+void RpcConnection::compactReadBuffer()
+{
+    memmove(readBuf.data(), readBuf.constData() + readPos, readEnd - readPos);
+    readEnd -= readPos;
+    scanPos -= readPos;
+    readPos = 0;
+}
+
+void RpcConnection::reserveReadBuffer(int size)
+{
+    if(readBuf.size() - readPos >= size)
+        return;
+    if(readPos > 0)
+        compactReadBuffer();
+    if(readBuf.size() < size)
+        readBuf.resize(size);
+}
+
+void RpcConnection::rejectOversizedLine(const QByteArray &start)
+{
+    // determine type and request ID of the message like processRawMessage() does
+    MessageType type = CommandMessage;
+    QByteArray rest = start;
+    if(start.startsWith('!'))
+        type = ControlMessage;
+    else if(start.startsWith('+'))
+    {
+        type = StreamChunkMessage;
+        rest = start.mid(2);
+    }
+    else if(!start.isEmpty() && start.at(0) >= '0' && start.at(0) <= '9')
+    {
+        type = ResponseMessage;
+        rest = start.mid(start.indexOf(' ') + 1);
+    }
+
+    quint32 requestId = 0;
+    if(type != ControlMessage && rest.startsWith('#'))
+    {
+        int idEnd = rest.indexOf(' ');
+        requestId = rest.mid(1, idEnd == -1 ? -1 : idEnd - 1).toUInt();
+        rest = (idEnd == -1) ? QByteArray() : rest.mid(idEnd + 1);
+    }
+    if(type == CommandMessage && rest.startsWith("async "))
+        type = AsyncCommandMessage;
+    else if(type == CommandMessage && rest.startsWith("* "))
+        type = BatchMessage;
+
+    rejectOversizedMessage(type, requestId);
+}
+
+void RpcConnection::rejectOversizedMessage(MessageType type, quint32 requestId)
+{
+    QByteArray error = "Message exceeds the maximum size of " + QByteArray::number(messageSizeLimit()) + " bytes";
+    qWarning("Received oversized message! Dropping it.");
+
+    switch(type)
+    {
+    case(CommandMessage):
+    case(BatchMessage):
+        sendResponse(requestId ? requestId : untaggedResponseId(), MessageTooLargeError, QVariant(error));
+        break;
+    case(ResponseMessage):
+    case(StreamChunkMessage):
+    {
+        PendingCall *call = takePendingCall(requestId);
+        if(call)
+            completeCall(call, MessageTooLargeError, QVariant(error));
+        break;
+    }
+    default:
+        // nobody waits for an answer
+        break;
+    }
+}
+
+quint32 RpcConnection::newRequestId()
+{
+    // 0 means "no request ID", IDs with the highest bit set are used for
+    // untagged commands of the peer, so start over before reaching them
+    if(nextRequestId == 0 || (nextRequestId & UNTAGGED_RESPONSE_ID))
+        nextRequestId = 1;
+    return nextRequestId++;
+}
+
+int RpcConnection::effectiveTimeout(int timeout) const
+{
+    return (timeout < 0) ? defaultTimeout : timeout;
+}
+
+quint32 RpcConnection::registerCall(PendingCall *call, int timeout)
+{
+    call->requestId = newRequestId();
+    pendingCalls.insert(call->requestId, call);
+
+    timeout = effectiveTimeout(timeout);
+    if(timeout > 0)
+    {
+        call->deadline = clock.elapsed() + timeout;
+        callDeadlines.insert(call->deadline, call->requestId);
+        // only the earliest deadline needs the timer
+        if(callDeadlines.constBegin().value() == call->requestId)
+            scheduleTimeouts();
+    }
+    return call->requestId;
+}
+
+RpcConnection::PendingCall *RpcConnection::takePendingCall(quint32 requestId)
+{
+    PendingCall *call = 0;
+    if(requestId)
+        call = pendingCalls.take(requestId);
+    else if(!untaggedCalls.isEmpty())
+        // untagged responses arrive in order: oldest untagged call first, which
+        // is gone already if it has been canceled or timed out
+        call = pendingCalls.take(untaggedCalls.dequeue());
+
+    if(call && call->deadline >= 0)
+        callDeadlines.remove(call->deadline, call->requestId);
+    return call;
+}
+
+void RpcConnection::scheduleTimeouts()
+{
+    if(callDeadlines.isEmpty()) {
+        timeoutTimer.stop();
+        return;
+    }
+    qint64 wait = callDeadlines.constBegin().key() - clock.elapsed();
+    timeoutTimer.start(int(qMax(wait, qint64(0))), this);
+}
+
+void RpcConnection::expireCalls()
+{
+    // completing a call may register new ones, so always look at the earliest deadline again
+    while(!callDeadlines.isEmpty() && callDeadlines.constBegin().key() <= clock.elapsed())
+    {
+        quint32 requestId = callDeadlines.constBegin().value();
+        PendingCall *call = takePendingCall(requestId);
+        if(!call) {
+            callDeadlines.erase(callDeadlines.begin());
+            continue;
+        }
+        if(call->tagged)
+            sendControlMessage("cancel", QByteArray::number(requestId));
+        completeCall(call, TimeoutError, QVariant("Call timed out"));
+    }
+    scheduleTimeouts();
+}
+
+QVariant RpcConnection::waitForResponse(PendingCall *call, int *errorCode)
+{
+    //processRawResponse() sets the response and quits the call's loop. Note
+    //that the response might already be there if a nested call waited for it.
+    if(!call->finished)
+        call->loop->exec();
+
+    if(errorCode)
+        *errorCode = call->errorCode;
+    return call->response;
+}
+
+void RpcConnection::processRawMessage(QByteArray message)
+{
+    if(message.length() == 0)
+        return;
+
+    // determine message type (command / response / control?) by first character
+    char first = message.at(0);
+    if(first == '!')
+    {
+        processControlMessage(message.mid(1));
+    }
+    else if(first == '+')
+    {
+        int idEnd = message.indexOf(' ', 2);
+        if(!message.startsWith("+ #") || idEnd == -1)
+            return;
+        processRawChunk(message.mid(3, idEnd - 3).toUInt(), 0, message.mid(idEnd + 1));
+    }
+    else if(first >= '0' && first <= '9')
+    {
+        int space = message.indexOf(' ');
+        if(space == -1)
+            return;
+
+        ErrorCode errorCode = (ErrorCode)message.left(space).toInt();
+        QByteArray resultData = message.mid(space + 1);
+
+        quint32 requestId = 0;
+        if(resultData.startsWith('#'))
+        {
+            int idEnd = resultData.indexOf(' ');
+            if(idEnd == -1)
+                return;
+            requestId = resultData.mid(1, idEnd - 1).toUInt();
+            resultData = resultData.mid(idEnd + 1);
+        }
+        processRawResponse(requestId, errorCode, 0, resultData);
+    }
+    else
+    {
+        quint32 requestId = 0;
+        if(message.startsWith('#')) {
+            int idEnd = message.indexOf(' ');
+            bool ok = false;
+            if(idEnd != -1)
+                requestId = message.mid(1, idEnd - 1).toUInt(&ok);
+            if(!ok) {
+                // an untagged answer would be taken for the answer to another command
+                qWarning("Received message with invalid request ID! Ignoring.");
+                return;
+            }
+            setPeerTagging(TaggingSupported);
+            message = message.mid(idEnd + 1);
+        }
+
+        if(message.startsWith("* ")) {
+            processRawBatch(requestId, 0, message.mid(2));
+            return;
+        }
+
+        bool async = false;
+        if(message.startsWith("async ")) {
+            async = true;
+            message = message.mid(6);
+            if(message.startsWith("* ")) {
+                processRawAsyncBatch(0, message.mid(2));
+                return;
+            }
+        }
+        processRawCommand(requestId, async, 0, message);
+    }
+}
+
+void RpcConnection::processFrame(MessageType type, quint8 flags, quint32 requestId, QByteArray payload)
+{
+    if(flags & CompressedFrameFlag)
+    {
+        if(!readCompressor) {
+            qWarning("Received frame which can't be decompressed! Ignoring.");
+            return;
+        }
+        // reject before the decompressed payload gets allocated
+        if(readCompressor->decompressedSize(payload) > messageSizeLimit()) {
+            rejectOversizedMessage(type, requestId);
+            return;
+        }
+        payload = readCompressor->decompress(payload);
+        if(payload.isEmpty()) {
+            qWarning("Received frame which can't be decompressed! Ignoring.");
+            return;
+        }
+        // compressors which can't tell the size in advance, or a wrong size
+        if(payload.size() > messageSizeLimit()) {
+            rejectOversizedMessage(type, requestId);
+            return;
+        }
+    }
+
+    switch(type)
+    {
+    case(CommandMessage):
+        processRawCommand(requestId, false, flags, payload);
+        break;
+    case(AsyncCommandMessage):
+        processRawCommand(0, true, flags, payload);
+        break;
+    case(ResponseMessage):
+    {
+        int space = payload.indexOf(' ');
+        if(space == -1)
+            return;
+        processRawResponse(requestId, (ErrorCode)payload.left(space).toInt(), flags, payload.mid(space + 1));
+        break;
+    }
+    case(ControlMessage):
+        processControlMessage(payload);
+        break;
+    case(BatchMessage):
+        processRawBatch(requestId, flags, payload);
+        break;
+    case(AsyncBatchMessage):
+        processRawAsyncBatch(flags, payload);
+        break;
+    case(StreamChunkMessage):
+        processRawChunk(requestId, flags, payload);
+        break;
+    default:
+        qWarning("Received frame of unknown type %d! Ignoring.", int(type));
+        break;
+    }
+}
+
+void RpcConnection::processRawCommand(quint32 requestId, bool async, quint8 flags, QByteArray rawData)
+{
+    //qDebug("Command: %s", rawData.constData());
+
+    int timeout = takeNumberPrefix(&rawData, '~');
+    int streamWindow = takeNumberPrefix(&rawData, '^');
+
+    // untagged commands are answered in order
+    bool tagged = (requestId != 0);
+    if(!tagged && !async)
+        requestId = untaggedResponseId();
+
+    // parse command
+    int split = rawData.indexOf(' ');
+    if(split == -1) {
+        if(!async)
+            sendResponseParseError(requestId, rawData);
+        return;
+    }
+    QByteArray commandName = rawData.left(split).trimmed();
+    QByteArray argumentsData = rawData.mid(split + 1); // don't trim, may be binary
+    invalidateCachesFor(commandName);
+
+    // cacheable commands answer the same encoded arguments with the same response
+    QByteArray cacheKey;
+    if(!async && commandMapper->isCommandResponseCacheable(commandName))
+    {
+        cacheKey = commandName + ' ' + incomingCodec(flags)->name() + ' ' + argumentsData;
+        quint8 responseFlags = 0;
+        QByteArray response;
+        if(commandMapper->findCachedResponse(outgoingCodec(&responseFlags)->name() + ' ' + cacheKey, &response)) {
+            sendMessage(ResponseMessage, responseFlags, requestId, QByteArray::number(NoError), response);
+            return;
+        }
+    }
+
+    // parse arguments
+    bool ok = false;
+    QVariant argumentsVariant = incomingCodec(flags)->decode(argumentsData, &ok);
+    if(!ok || argumentsVariant.type() != QVariant::List) {
+        if(!async)
+            sendResponseParseError(requestId, rawData);
+        return;
+    }
+    executeCommand(requestId, async, commandName, argumentsVariant.toList(), timeout, streamWindow, cacheKey);
+}
+
+bool RpcConnection::startStreamedCommand()
+{
+    // the head of the line has to be there: [#id ][async ][~t ][^w ]name
+    QByteArray head(readBuf.constData() + readPos, qMin(readEnd - readPos, MAX_STREAMED_HEAD_SIZE));
+    if(head.isEmpty() || head.at(0) == '!' || head.at(0) == '+' || (head.at(0) >= '0' && head.at(0) <= '9'))
+        return false;
+
+    QByteArray rest = head;
+    quint32 requestId = 0;
+    if(rest.startsWith('#')) {
+        int idEnd = rest.indexOf(' ');
+        bool ok = false;
+        if(idEnd != -1)
+            requestId = rest.mid(1, idEnd - 1).toUInt(&ok);
+        if(!ok)
+            return false;
+        rest = rest.mid(idEnd + 1);
+    }
+    bool async = rest.startsWith("async ");
+    if(async)
+        rest = rest.mid(6);
+    // batches are decoded at once
+    if(rest.startsWith('*'))
+        return false;
+    int timeout = takeNumberPrefix(&rest, '~');
+    int streamWindow = takeNumberPrefix(&rest, '^');
+    int split = rest.indexOf(' ');
+    if(split == -1)
+        return false;
+
+    if(requestId)
+        setPeerTagging(TaggingSupported);
+    StreamedCommand *command = new StreamedCommand;
+    command->async = async;
+    command->requestId = async ? 0 : (requestId ? requestId : untaggedResponseId());
+    command->commandName = rest.left(split).trimmed();
+    command->timeout = timeout;
+    command->streamWindow = streamWindow;
+    command->head = head.left(head.size() - rest.size() + split);
+    invalidateCachesFor(command->commandName);
+
+    // the arguments are fed to the decoder from here on
+    readPos += command->head.size() + 1;
+    command->size = command->head.size() + 1;
+    scanPos = qMax(scanPos, readPos);
+    streamedCommand = command;
+    return true;
+}
+
+void RpcConnection::finishStreamedCommand()
+{
+    StreamedCommand *command = streamedCommand;
+    streamedCommand = 0;
+
+    bool ok = false;
+    QVariant arguments = command->decoder.finish(&ok);
+    if(!ok || arguments.type() != QVariant::List) {
+        if(!command->async)
+            sendResponseParseError(command->requestId, command->head + " ...");
+    }
+    else
+        executeCommand(command->requestId, command->async, command->commandName, arguments.toList(),
+                       command->timeout, command->streamWindow, QByteArray());
+    delete command;
+}
+
+void RpcConnection::executeCommand(quint32 requestId, bool async, const QByteArray &commandName, const QVariantList &arguments,
+                                   int timeout, int streamWindow, const QByteArray &cacheKey)
+{
+    // unknown commands and objects of this thread run right here
+    QThread *objectThread = threadAffineDispatch ? commandMapper->commandThread(commandName) : 0;
+    bool otherThread = objectThread && objectThread != thread();
+
+    if(async)
+    {
+        runCommandAsync(commandName, arguments, timeout);
+    }
+    else if(parallelDispatch || otherThread)
+    {
+        // run the command on the thread pool or the object's thread, it's
+        // answered when done (untagged answers are held back until the ones
+        // before have been sent)
+        RpcCommandJob *job = new RpcCommandJob(responseChannel, commandMapper, requestId, commandName, arguments, timeout);
+        job->streamWindow = streamWindow;
+        job->cacheKey = cacheKey;
+        dispatchCommand(job);
+    }
+    else
+    {
+        // commands run right away, so the caller's timeout can't have passed yet
+        // run the command
+        RpcCommandMapper::CommandResult result = commandMapper->runCommand(commandName, arguments);
+        if(deferResponse(requestId, result, streamWindow))
+            return;
+
+        sendCommandResponse(requestId, commandName, result, cacheKey);
+    }
+}
+
+void RpcConnection::processRawBatch(quint32 requestId, quint8 flags, QByteArray rawData)
 {
-    connect(signalMapper, SIGNAL(mappedCommand(QByteArray,QVariantList)),
-            SLOT(remoteCall(QByteArray,QVariantList)));
-    connect(signalMapper, SIGNAL(mappedCommandAsync(QByteArray,QVariantList)),
-            SLOT(remoteCallAsync(QByteArray,QVariantList)));
+    if(!requestId)
+        requestId = untaggedResponseId();
+    int timeout = takeNumberPrefix(&rawData, '~');
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    bool ok = false;
+    QVariant batchVariant = incomingCodec(flags)->decode(rawData, &ok);
+    if(!ok || batchVariant.type() != QVariant::List) {
+        sendResponseParseError(requestId, rawData);
+        return;
+    }
+
+    // run all commands in order and answer with a list of [error code, result]
+    QVariantList results;
+    foreach(QVariant entry, batchVariant.toList())
+    {
+        QVariantList call = entry.toList();
+        QVariant data;
+        ErrorCode errorCode;
+        if(call.count() != 2 || call.at(1).type() != QVariant::List)
+        {
+            errorCode = ParseError;
+            data = QVariant("Error parsing batch entry");
+        }
+        else if(timeout > 0 && elapsed.hasExpired(timeout))
+        {
+            // the caller has given up already, don't run the rest of the batch
+            errorCode = TimeoutError;
+            data = QVariant("Call timed out");
+        }
+        else
+        {
+            QByteArray commandName = call.at(0).toString().toUtf8();
+            invalidateCachesFor(commandName);
+            RpcCommandMapper::CommandResult result = commandMapper->runCommand(commandName, call.at(1).toList());
+            errorCode = processCommandResult(commandName, result, &data);
+        }
+        results << QVariant(QVariantList() << int(errorCode) << data);
+    }
+    sendResponseSuccess(requestId, results);
 }
 
-void RpcConnection::setPeerDevice(QIODevice *peerDevice)
+void RpcConnection::processRawAsyncBatch(quint8 flags, QByteArray rawData)
 {
-    if(device) {
-        device->disconnect(this);
+    bool ok = false;
+    QVariant batchVariant = incomingCodec(flags)->decode(rawData, &ok);
+    if(!ok || batchVariant.type() != QVariant::List) {
+        qWarning("Received invalid asynchronous batch! Ignoring.");
+        return;
     }
-    device = peerDevice;
-    if(device) {
-        connect(device, SIGNAL(readyRead()), SLOT(device_readyRead()));
+
+    QList<QPair<QByteArray, QVariantList> > commands;
+    foreach(QVariant entry, batchVariant.toList())
+    {
+        QVariantList call = entry.toList();
+        if(call.count() != 2 || call.at(1).type() != QVariant::List) {
+            qWarning("Received invalid asynchronous batch entry! Ignoring.");
+            continue;
+        }
+        QByteArray commandName = call.at(0).toString().toUtf8();
+        invalidateCachesFor(commandName);
+        commands << qMakePair(commandName, call.at(1).toList());
+    }
+
+    // the commands run one after another: as ordered jobs, each started once
+    // the one before has finished, or in a single concurrent run
+    if(commandExecutor || threadAffineDispatch)
+    {
+        ensureResponseChannel();
+        for(int i = 0; i < commands.count(); ++i)
+        {
+            RpcCommandJob *job = new RpcCommandJob(responseChannel, commandMapper, 0, commands.at(i).first, commands.at(i).second, 0);
+            job->async = true;
+            job->ordered = true;
+            dispatchCommand(job);
+        }
     }
+    else if(!commands.isEmpty())
+        QtConcurrent::run(&RpcConnection::runCommandsInOrder, commandMapper, commands);
 }
 
-QIODevice *RpcConnection::peerDevice() const
+void RpcConnection::runCommandAsync(const QByteArray &commandName, const QVariantList &arguments, int timeout)
 {
-    return device;
+    // run the command concurrently
+    if(commandExecutor || threadAffineDispatch)
+    {
+        ensureResponseChannel();
+        RpcCommandJob *job = new RpcCommandJob(responseChannel, commandMapper, 0, commandName, arguments, timeout);
+        job->async = true;
+        dispatchCommand(job);
+    }
+    else
+        QtConcurrent::run(commandMapper, &RpcCommandMapper::runCommand, commandName, arguments);
 }
 
-void RpcConnection::mapCommandToSlot(const QByteArray &commandName, QObject *object, const char *member)
+void RpcConnection::runCommandsInOrder(RpcCommandMapper *commandMapper, QList<QPair<QByteArray, QVariantList> > commands)
 {
-    commandMapper->addMapping(commandName, object, member);
+    for(int i = 0; i < commands.count(); ++i)
+        commandMapper->runCommand(commands.at(i).first, commands.at(i).second);
 }
 
-void RpcConnection::mapAllCommandsToSlots(QObject *object)
+bool RpcConnection::deferResponse(quint32 requestId, const RpcCommandMapper::CommandResult &result, int streamWindow)
 {
-    const QMetaObject *mo = object->metaObject();
-    // skip QObject's members
-    for(int i = QObject::staticMetaObject.methodCount(); i < mo->methodCount(); ++i)
+    if(result.code != RpcCommandMapper::DeferredResult)
+        return false;
+
+    if(result.value.userType() == qMetaTypeId<RpcStreamWriter>())
     {
-        if(mo->method(i).methodType() == QMetaMethod::Slot ||
-            mo->method(i).methodType() == QMetaMethod::Method)
-        {
-            //qDebug("Found method: %s", mo->method(i).signature());
-            QByteArray memberName = mo->method(i).signature();
-            memberName = memberName.left(memberName.indexOf('(')); // remove arguments
-            mapCommandToSlot(memberName, object, memberName.constData());
-        }
+        ensureResponseChannel();
+        OutgoingStream stream;
+        // our copy mustn't keep the stream open once the command dropped its handles
+        stream.writer = result.value.value<RpcStreamWriter>().observer();
+        stream.streaming = (streamWindow > 0);
+        outgoingStreams.insert(requestId, stream);
+        // callers not reading streams take all chunks at once
+        stream.writer.setTarget(new RpcStreamResponse(responseChannel, requestId), stream.streaming ? streamWindow : INT_MAX);
+        return true;
     }
-}
 
-void RpcConnection::mapSignalToCommand(QObject *object, const char *signal, const QByteArray &commandName)
-{
-    signalMapper->addMapping(object, signal, commandName);
+    if(result.value.userType() == qMetaTypeId<QFuture<QVariant> >())
+    {
+        QFutureWatcher<QVariant> *watcher = new QFutureWatcher<QVariant>(this);
+        deferredFutures.insert(watcher, requestId);
+        connect(watcher, SIGNAL(finished()), SLOT(deferredFuture_finished()));
+        watcher->setFuture(result.value.value<QFuture<QVariant> >());
+    }
+    else
+    {
+        ensureResponseChannel();
+        RpcDeferredReply reply = result.value.value<RpcDeferredReply>();
+        reply.setTarget(new RpcDeferredResponse(responseChannel, requestId));
+    }
+    return true;
 }
 
-void RpcConnection::mapAllSignalsToCommands(QObject *object)
+void RpcConnection::sendStreamChunks(quint32 requestId)
 {
-    const QMetaObject *mo = object->metaObject();
-    // skip QObject's members
-    for(int i = QObject::staticMetaObject.methodCount(); i < mo->methodCount(); ++i)
+    if(!outgoingStreams.contains(requestId))
+        return;
+
+    OutgoingStream &stream = outgoingStreams[requestId];
+    bool ended = false;
+    bool successful = false;
+    QVariant result;
+    QVariantList chunks = stream.writer.takeChunks(&ended, &successful, &result);
+    if(!stream.streaming)
+        stream.collected += chunks;
+    else
     {
-        if(mo->method(i).methodType() == QMetaMethod::Signal)
+        foreach(QVariant chunk, chunks)
         {
-            //qDebug("Found signal: %s", mo->method(i).signature());
-            QByteArray commandName = mo->method(i).signature();
-            commandName = commandName.left(commandName.indexOf('(')); // remove arguments to get command name
-            mapSignalToCommand(object, mo->method(i).signature(), commandName);
+            quint8 flags = 0;
+            bool ok = false;
+            QByteArray encodedChunk = outgoingCodec(&flags)->encode(chunk, true, &ok);
+            sendMessage(StreamChunkMessage, flags, requestId, QByteArray(), encodedChunk);
         }
     }
+
+    if(ended)
+    {
+        if(successful && !stream.streaming)
+            result = stream.collected;
+        sendResponse(requestId, successful ? NoError : SystemError, result);
+        outgoingStreams.remove(requestId);
+    }
 }
 
-QVariant RpcConnection::remoteCall(QByteArray command, QVariantList arguments, int *errorCode)
+void RpcConnection::deferredFuture_finished()
 {
-    sendCommand(command, arguments);
-    QVariant response = waitForResponse(errorCode);
-    return response;
+    QFutureWatcher<QVariant> *watcher = static_cast<QFutureWatcher<QVariant> *>(sender());
+    if(!deferredFutures.contains(watcher))
+        return;
+
+    quint32 requestId = deferredFutures.take(watcher);
+    QFuture<QVariant> future = watcher->future();
+    if(future.isCanceled())
+        sendResponse(requestId, SystemError, QVariant("Command canceled"));
+    else
+        sendResponse(requestId, NoError, future.resultCount() ? future.result() : QVariant());
+    watcher->deleteLater();
 }
 
-void RpcConnection::remoteCallAsync(QByteArray command, QVariantList arguments)
+RpcConnection::ErrorCode RpcConnection::processCommandResult(const QByteArray &commandName, const RpcCommandMapper::CommandResult &result, QVariant *data)
 {
-    sendCommandAsync(command, arguments);
+    switch(result.code)
+    {
+    case(RpcCommandMapper::Successful):
+        *data = result.value;
+        return NoError;
+    case(RpcCommandMapper::CommandDoesntExistError):
+        *data = QVariant("No such command: " + commandName);
+        return SystemError;
+    case(RpcCommandMapper::CommandSignatureMismatchError):
+        *data = QVariant("Signature mismatch for command " + commandName);
+        return SystemError;
+    case(RpcCommandMapper::DeferredResult):
+        // only reached by batches, which are answered at once
+        *data = QVariant("Command " + commandName + " can't reply deferred in a batch");
+        return SystemError;
+    default:
+        qWarning("Error in implementation of RpcCommandMapper::runCommand().");
+        *data = QVariant();
+        return SystemError;
+    }
 }
 
-void RpcConnection::registerEnums(const QMetaObject *metaObject)
+void RpcConnection::processRawResponse(quint32 requestId, ErrorCode errorCode, quint8 flags, QByteArray resultData)
 {
-    //qDebug("Registering enums of class %s", metaObject->className());
-    for(int i = QObject::staticMetaObject.enumeratorOffset(); i < metaObject->enumeratorCount(); ++i)
+    if(!requestId && errorCode == ParseError)
     {
-        QMetaEnum metaEnum = metaObject->enumerator(i);
-        QByteArray enumTypeName = QByteArray(metaObject->className()) + "::" + metaEnum.name();
-        int enumType = QMetaType::type(enumTypeName.constData());
-        if(enumType)
-            QJson::treatMetaTypeAsInteger(enumType);
+        // older peers don't know control messages and answer each of them,
+        // starting with our announcement, with this error; it answers no call
+        QString error = incomingCodec(flags)->decode(resultData, 0).toString();
+        if(error.startsWith("Error parsing command: !"))
+        {
+            setPeerTagging(TaggingUnsupported);
+            return;
+        }
+    }
+
+    PendingCall *call = takePendingCall(requestId);
+    if(!call)
+    {
+        qWarning("Received response, but I didn't send command! Ignoring.");
+        return;
     }
+
+    completeCall(call, errorCode, incomingCodec(flags)->decode(resultData, 0));
 }
 
-void RpcConnection::device_readyRead()
+void RpcConnection::processRawChunk(quint32 requestId, quint8 flags, QByteArray chunkData)
+{
+    PendingCall *call = pendingCalls.value(requestId);
+    if(!call || !call->streamWindow)
+    {
+        qWarning("Received stream chunk, but I didn't call a stream! Ignoring.");
+        return;
+    }
+
+    bool ok = false;
+    QVariant chunk = incomingCodec(flags)->decode(chunkData, &ok);
+    if(!ok) {
+        qWarning("Received stream chunk which can't be parsed! Ignoring.");
+        return;
+    }
+
+    if(call->receiver)
+    {
+        if(!QMetaObject::invokeMethod(call->receiver, call->chunkMember.constData(), Q_ARG(QVariant, chunk)))
+            qWarning("Can't invoke callback \"%s\" of class %s.",
+                     call->chunkMember.constData(), call->receiver->metaObject()->className());
+    }
+
+    // grant credit in steps of half the window, the callback may have ended the call
+    call = pendingCalls.value(requestId);
+    if(call && ++call->chunksDelivered >= qMax(call->streamWindow / 2, 1))
+    {
+        sendControlMessage("credit", QByteArray::number(requestId) + " " + QByteArray::number(call->chunksDelivered));
+        call->chunksDelivered = 0;
+    }
+}
+
+void RpcConnection::processControlMessage(QByteArray message)
 {
-    // read data from device into internal buffer
-    readBuf += device->readAll();
-    int messageEnd = readBuf.indexOf(MESSAGE_DELIM);
+    message = message.trimmed();
+    int split = message.indexOf(' ');
+    QByteArray name = (split == -1) ? message : message.left(split);
+    QByteArray value = (split == -1) ? QByteArray() : message.mid(split + 1).trimmed();
 
-    // is there (at least) one message?
-    if(messageEnd != -1)
+    if(name == "framing")
     {
-        QByteArray message = readBuf.left(messageEnd);
-        processRawMessage(message);
+        FramingMode mode;
+        if(value == "binary")
+            mode = BinaryFraming;
+        else if(value == "line")
+            mode = LineFraming;
+        else {
+            qWarning("Peer requested unknown framing mode \"%s\"! Ignoring.", value.constData());
+            return;
+        }
 
-        if(messageEnd == readBuf.length() - 1)
+        // everything the peer sends after this message uses the new framing
+        readFraming = mode;
+        if(framingRequested)
+        {
+            // this is the answer to our own request
+            framingRequested = false;
+            if(mode != writeFraming)
+            {
+                // refused, so switch back; the peer acknowledges this again
+                sendControlMessage(name, value);
+                writeFraming = mode;
+                framingRequested = true;
+            }
+        }
+        else if(mode == BinaryFraming && !binaryFramingAccepted)
+        {
+            // refuse, keeping our framing; the peer switches back
+            qWarning("Peer requested binary framing, which isn't accepted! Refusing.");
+            sendControlMessage(name, "line");
+        }
+        else
+        {
+            // acknowledge using the old framing, then switch
+            sendControlMessage(name, value);
+            writeFraming = mode;
+        }
+    }
+    else if(name == "codec")
+    {
+        RpcCodec *codec = RpcCodec::codec(value);
+        if(requestedCodec)
+        {
+            // answer to our request: either accepted or rejected (then "json")
+            if(codec != requestedCodec || codec == RpcCodec::defaultCodec())
+                codec = 0;
+            readCodec = writeCodec = codec;
+            requestedCodec = 0;
+        }
+        else
+        {
+            // request of the peer: accept if we know and accept the codec, otherwise fall back to JSON
+            if(codec && !acceptedCodecs.contains(codec->name()) && codec != RpcCodec::defaultCodec()) {
+                qWarning("Peer requested codec \"%s\", which isn't accepted! Refusing.", value.constData());
+                codec = 0;
+            }
+            if(!codec || (codec->isBinary() && readFraming != BinaryFraming))
+                codec = RpcCodec::defaultCodec();
+            sendControlMessage(name, codec->name());
+            readCodec = writeCodec = (codec == RpcCodec::defaultCodec()) ? 0 : codec;
+        }
+    }
+    else if(name == "compression")
+    {
+        // "none" or an unknown compressor yields 0
+        RpcCompressor *compressor = RpcCompressor::compressor(value);
+        if(!requestedCompression.isEmpty())
         {
-            // there is no more data
-            readBuf.clear();
+            // answer to our request: either accepted or rejected (then "none")
+            if(value != requestedCompression)
+                compressor = 0;
+            readCompressor = writeCompressor = compressor;
+            requestedCompression.clear();
         }
         else
         {
-            // there is more data
-            readBuf = readBuf.mid(messageEnd + 1);
-            // re-call this slot to process more data:
-            device_readyRead();
+            // request of the peer: accept if we know and accept the compressor
+            if(compressor && !acceptedCompressors.contains(compressor->name())) {
+                qWarning("Peer requested compressor \"%s\", which isn't accepted! Refusing.", value.constData());
+                compressor = 0;
+            }
+            if(readFraming != BinaryFraming)
+                compressor = 0;
+            sendControlMessage(name, compressor ? compressor->name() : QByteArray("none"));
+            readCompressor = writeCompressor = compressor;
+        }
+    }
+    else if(name == "credit")
+    {
+        int split = value.indexOf(' ');
+        quint32 requestId = value.left(split).toUInt();
+        if(split == -1 || !outgoingStreams.contains(requestId))
+            return;
+        outgoingStreams[requestId].writer.addCredits(value.mid(split + 1).toInt());
+        sendStreamChunks(requestId);
+    }
+    else if(name == "cancel")
+    {
+        quint32 requestId = value.toUInt();
+        if(outgoingStreams.contains(requestId)) {
+            outgoingStreams.take(requestId).writer.cancel();
+            return;
+        }
+
+        // skip the command if it still waits for a worker; otherwise it's done or can't be stopped
+        if(!responseChannel)
+            return;
+        QMutexLocker locker(&responseChannel->mutex);
+        if(responseChannel->queuedRequests.contains(requestId))
+            responseChannel->canceledRequests.insert(requestId);
+    }
+    else if(name == "tagging")
+    {
+        setPeerTagging(TaggingSupported);
+    }
+    else if(name == "subscriptions")
+    {
+        peerWantsSubscriptions = true;
+        announceSubscriptions();
+    }
+    else if(name == "subscribe" || name == "unsubscribe")
+    {
+        if(!signalSubscription)
+            return;
+        bool subscribe = (name == "subscribe");
+        foreach(QByteArray commandName, value.split(' '))
+        {
+            if(commandName.isEmpty())
+                continue;
+            if(subscribe)
+                subscribedCommands.insert(commandName);
+            else
+                subscribedCommands.remove(commandName);
+            if(signalMapper)
+                signalMapper->setCommandEnabled(commandName, subscribe);
         }
     }
+    else
+        qWarning("Received unknown control message \"%s\"! Ignoring.", name.constData());
 }
 
-QVariant RpcConnection::waitForResponse(int *errorCode)
+void RpcConnection::completeCall(PendingCall *call, int errorCode, const QVariant &response)
 {
-    //This call should set both availableResponse and availableErrorCode
-    responseLoop.exec();
+    if(errorCode == NoError && !call->cacheKey.isEmpty())
+        storeCachedResult(call, response);
 
-    QVariant result = availableResponse;
-    availableResponse = QVariant(); // reset
-    if(errorCode)
-        *errorCode = availableErrorCode;
-    return result;
+    if(call->loop)
+    {
+        // the waiter in remoteCall() picks up the result
+        call->response = response;
+        call->errorCode = errorCode;
+        call->finished = true;
+        call->loop->quit();
+        return;
+    }
+
+    if(call->hasFuture)
+    {
+        call->future.reportResult(response);
+        if(errorCode != NoError)
+            call->future.reportCanceled();
+        call->future.reportFinished();
+    }
+    if(call->receiver)
+    {
+        if(!QMetaObject::invokeMethod(call->receiver, call->member.constData(),
+                                      Q_ARG(QVariant, response), Q_ARG(int, errorCode)))
+            qWarning("Can't invoke callback \"%s\" of class %s.",
+                     call->member.constData(), call->receiver->metaObject()->className());
+    }
+    delete call;
 }
 
-void RpcConnection::processRawMessage(QByteArray message)
+void RpcConnection::ensureResponseChannel()
 {
-    if(message.length() == 0)
+    if(!responseChannel)
+        responseChannel = QSharedPointer<RpcResponseChannel>(new RpcResponseChannel(this));
+}
+
+void RpcConnection::dispatchCommand(RpcCommandJob *job)
+{
+    if(job->async && !job->ordered)
+    {
+        startJob(job);
         return;
+    }
 
-    // determine message type (command / response?) by first character
-    char first = message.at(0);
-    if(first >= '0' && first <= '9')
-        processRawResponse(message);
+    // asynchronous jobs (of a batch) come ordered already and can't be canceled
+    if(!job->async)
+    {
+        {
+            QMutexLocker locker(&responseChannel->mutex);
+            responseChannel->queuedRequests.insert(job->requestId);
+        }
+        job->ordered = commandMapper->isCommandOrdered(job->commandName);
+    }
+    if(job->ordered)
+    {
+        orderedJobs.enqueue(job);
+        if(!orderedJobRunning)
+            startNextOrderedJob();
+    }
     else
-        processRawCommand(message);
+        startJob(job);
 }
 
-void RpcConnection::processRawCommand(QByteArray rawData)
+bool RpcConnection::startJob(RpcCommandJob *job)
 {
-    //qDebug("Command: %s", rawData.constData());
-
-    bool async = false;
-    if(rawData.startsWith("async ")) {
-        async = true;
-        rawData = rawData.mid(6);
+    if(threadAffineDispatch)
+    {
+        QThread *objectThread = commandMapper->commandThread(job->commandName);
+        if(objectThread && RpcCommandMapper::runInThread(objectThread, job))
+            return true;
+        // the object mustn't be used from any other thread
+        if(objectThread)
+        {
+            if(job->async)
+                qWarning("Thread of command %s isn't running! Dropping asynchronous command.", job->commandName.constData());
+            else
+            {
+                {
+                    QMutexLocker locker(&responseChannel->mutex);
+                    responseChannel->queuedRequests.remove(job->requestId);
+                }
+                sendResponse(job->requestId, SystemError, QVariant("Thread of command " + job->commandName + " isn't running"));
+            }
+            delete job;
+            return false;
+        }
+    }
+    if(!commandExecutor) {
+        QThreadPool::globalInstance()->start(job);
+        return true;
+    }
+    RpcExecutor::Priority priority = commandExecutor->commandPriority(job->commandName);
+    if(commandExecutor->submit(job, priority))
+    {
+        // don't take more commands from the peer until the executor catches up
+        if(!readPaused && priority != RpcExecutor::HighPriority &&
+           commandExecutor->overflowPolicy() == RpcExecutor::BlockReader && commandExecutor->isQueueFull())
+            pauseReading();
+        return true;
     }
 
-    // parse command
-    int split = rawData.indexOf(' ');
-    if(split == -1) {
-        sendResponseParseError(rawData);
-        return;
+    if(job->async)
+        qWarning("Executor is busy! Dropping asynchronous command.");
+    else
+    {
+        {
+            QMutexLocker locker(&responseChannel->mutex);
+            responseChannel->queuedRequests.remove(job->requestId);
+        }
+        sendResponse(job->requestId, BusyError, QVariant("Busy, command " + job->commandName + " rejected"));
     }
-    QByteArray commandName = rawData.left(split).trimmed();
-    QByteArray argumentsData = rawData.mid(split + 1).trimmed();
+    delete job;
+    return false;
+}
 
-    // parse arguments
-    QVariant argumentsVariant = QJson::decode(argumentsData);
-    if(argumentsVariant.type() != QVariant::List) {
-        sendResponseParseError(rawData);
-        return;
+void RpcConnection::startNextOrderedJob()
+{
+    orderedJobRunning = false;
+    while(!orderedJobs.isEmpty() && !orderedJobRunning)
+        orderedJobRunning = startJob(orderedJobs.dequeue());
+}
+
+void RpcConnection::sendMessage(MessageType type, quint8 flags, quint32 requestId, const QByteArray &head, const QByteArray &body)
+{
+    // signals emitted before must arrive first, also before responses and chunks
+    if(type != ControlMessage && type != AsyncBatchMessage && !signalBatch.isEmpty())
+        sendSignalBatch();
+
+    // answers to untagged commands go out untagged, in order
+    quint32 responseOrderId = 0;
+    if(type == ResponseMessage && (requestId & UNTAGGED_RESPONSE_ID)) {
+        responseOrderId = requestId;
+        requestId = 0;
     }
-    QVariantList arguments = argumentsVariant.toList();
 
-    if(async)
+    QByteArray message;
+    if(writeFraming == BinaryFraming)
     {
-        // run the command concurrently
-        QtConcurrent::run(commandMapper, &RpcCommandMapper::runCommand, commandName, arguments);
+        quint32 length = head.length() + (head.isEmpty() ? 0 : 1) + body.length();
+        message.reserve(FRAME_HEADER_SIZE + length);
+        message.resize(FRAME_HEADER_SIZE);
+        message += head;
+        if(!head.isEmpty())
+            message += ' ';
+        message += body;
+
+        // compress large payloads, if it actually makes them smaller
+        if(writeCompressor && length >= quint32(compressionThreshold))
+        {
+            QByteArray compressed = writeCompressor->compress(
+                        QByteArray::fromRawData(message.constData() + FRAME_HEADER_SIZE, length));
+            if(!compressed.isEmpty() && quint32(compressed.length()) < length)
+            {
+                message.resize(FRAME_HEADER_SIZE);
+                message += compressed;
+                length = compressed.length();
+                flags |= CompressedFrameFlag;
+            }
+        }
+
+        uchar *header = reinterpret_cast<uchar *>(message.data());
+        qToBigEndian<quint32>(length, header);
+        header[4] = quint8(type);
+        header[5] = flags;
+        qToBigEndian<quint32>(requestId, header + 6);
     }
     else
     {
-        // run the command
-        RpcCommandMapper::CommandResult result = commandMapper->runCommand(commandName, arguments);
-
-        // proces result
-        switch(result.code)
+        switch(type)
         {
-        case(RpcCommandMapper::Successful):
-            sendResponseSuccess(result.value);
+        case(CommandMessage):
+            if(requestId)
+                message = "#" + QByteArray::number(requestId) + " ";
+            message += head + " " + body;
             break;
-        case(RpcCommandMapper::CommandDoesntExistError):
-            sendResponseCommandDoesntExistError(commandName);
+        case(AsyncCommandMessage):
+            message = "async " + head + " " + body;
             break;
-        case(RpcCommandMapper::CommandSignatureMismatchError):
-            sendResponseCommandSignatureMismatchError(commandName);
+        case(BatchMessage):
+            if(requestId)
+                message = "#" + QByteArray::number(requestId) + " ";
+            message += "* ";
+            if(!head.isEmpty())
+                message += head + " ";
+            message += body;
             break;
-        default:
-            qWarning("Error in implementation of RpcCommandMapper::runCommand().");
+        case(ResponseMessage):
+            // answer untagged commands untagged, so peers without request IDs still understand us
+            message = head + " ";
+            if(requestId)
+                message += "#" + QByteArray::number(requestId) + " ";
+            message += body;
+            break;
+        case(ControlMessage):
+            message = "!" + head + " " + body;
+            break;
+        case(StreamChunkMessage):
+            message = "+ #" + QByteArray::number(requestId) + " " + body;
+            break;
+        case(AsyncBatchMessage):
+            message = "async * " + body;
             break;
         }
+        message += MESSAGE_DELIM;
+    }
+
+    if(responseOrderId) {
+        // answers to commands of a previous peer device are dropped
+        if(!untaggedResponseOrder.contains(responseOrderId))
+            return;
+        heldUntaggedResponses.insert(responseOrderId, message);
+        while(!untaggedResponseOrder.isEmpty() && heldUntaggedResponses.contains(untaggedResponseOrder.head()))
+            sendRawMessage(heldUntaggedResponses.take(untaggedResponseOrder.dequeue()));
+        return;
     }
+    sendRawMessage(message);
 }
 
-void RpcConnection::processRawResponse(QByteArray response)
+quint32 RpcConnection::untaggedResponseId()
 {
-    int space = response.indexOf(' ');
-    if(space == -1)
-        return;
+    quint32 id = UNTAGGED_RESPONSE_ID | (nextUntaggedResponseId++ & ~UNTAGGED_RESPONSE_ID);
+    untaggedResponseOrder.enqueue(id);
+    return id;
+}
 
-    ErrorCode errorCode = (ErrorCode)response.left(space).toInt();
-    QVariant result = QJson::decode(response.mid(space + 1));
+void RpcConnection::sendRawMessage(QByteArray message)
+{
+    // collect messages and write them at once (see flushNow())
+    writeBuf += message;
+    if(writeBuf.size() >= flushThreshold)
+        flushNow();
+    else if(!flushTimer.isActive())
+        flushTimer.start(flushDelay, this);
+    updateCongestion();
+}
 
-    if(!availableResponse.isNull())
-        qWarning("Received response, but I didn't send command! Ignoring.");
-    else
-    {
-        availableResponse = result;
-        availableErrorCode = errorCode;
-        responseLoop.quit();
-    }
+void RpcConnection::sendControlMessage(const QByteArray &name, const QByteArray &value)
+{
+    sendMessage(ControlMessage, 0, 0, name, value);
 }
 
-void RpcConnection::sendRawMessage(QByteArray message)
+int RpcConnection::takeNumberPrefix(QByteArray *data, char marker)
 {
-    device->write(message);
-    emit deviceFlush();
+    if(!data->startsWith(marker))
+        return 0;
+    int end = data->indexOf(' ');
+    if(end == -1)
+        return 0;
+    int timeout = data->mid(1, end - 1).toInt();
+    data->remove(0, end + 1);
+    return timeout;
 }
 
-void RpcConnection::sendCommand(QByteArray command, QVariantList arguments)
+QByteArray RpcConnection::methodName(const char *member)
 {
-    QJson::Error jsonError;
-    QString encodedArguments =
-        QJson::encode(arguments, QJson::EncodeOptions(QJson::Compact), &jsonError);
-    if(!jsonError.isNull())
-        qWarning("JSON error: %s", qPrintable(jsonError.text()));
-    else
-        sendRawMessage(command + " " + encodedArguments.toUtf8() + "\n");
+    // remove leading digit of SLOT() macro and arguments if present
+    QByteArray memberName = (member[0] >= '0' && member[0] <= '2')
+            ? QByteArray(member + 1)
+            : QByteArray(member);
+    if(memberName.indexOf('(') != -1)
+        memberName = memberName.left(memberName.indexOf('('));
+    return memberName;
+}
+
+void RpcConnection::sendCommand(quint32 requestId, QByteArray command, QVariantList arguments, int timeout, int streamWindow)
+{
+    // reading streams needs a peer understanding request IDs anyway
+    if(peerTagging != TaggingSupported && !streamWindow) {
+        untaggedCalls.enqueue(requestId);
+        sendCommandMessage(CommandMessage, 0, command, arguments);
+        return;
+    }
+    pendingCalls.value(requestId)->tagged = true;
+
+    if(streamWindow > 0)
+        command = "^" + QByteArray::number(streamWindow) + " " + command;
+    if(timeout > 0)
+        command = "~" + QByteArray::number(timeout) + " " + command;
+    sendCommandMessage(CommandMessage, requestId, command, arguments);
 }
 
 void RpcConnection::sendCommandAsync(QByteArray command, QVariantList arguments)
 {
-    // little hack but this avoids code duplication: prepend "async " to command
-    sendCommand("async " + command, arguments);
+    sendCommandMessage(AsyncCommandMessage, 0, command, arguments);
+}
+
+void RpcConnection::sendCommandMessage(MessageType type, quint32 requestId, QByteArray command, QVariantList arguments)
+{
+    quint8 flags = 0;
+    bool ok = false;
+    QByteArray encodedArguments = outgoingCodec(&flags)->encode(arguments, false, &ok);
+    if(ok)
+        sendMessage(type, flags, requestId, command, encodedArguments);
 }
 
-void RpcConnection::sendResponse(ErrorCode errorCode, QVariant data)
+void RpcConnection::sendBatch(quint32 requestId, QVariantList batch, int timeout)
 {
-    QString json = QJson::encode(data, QJson::EncodeOptions(QJson::Compact | QJson::EncodeUnknownTypesAsNull));
-    sendRawMessage(QByteArray::number(errorCode) + " " + json.toUtf8() + "\n");
+    quint8 flags = 0;
+    bool ok = false;
+    QByteArray encodedBatch = outgoingCodec(&flags)->encode(batch, false, &ok);
+    if(!ok)
+        return;
+    if(peerTagging != TaggingSupported) {
+        untaggedCalls.enqueue(requestId);
+        sendMessage(BatchMessage, flags, 0, QByteArray(), encodedBatch);
+        return;
+    }
+    pendingCalls.value(requestId)->tagged = true;
+    QByteArray head = (timeout > 0) ? "~" + QByteArray::number(timeout) : QByteArray();
+    sendMessage(BatchMessage, flags, requestId, head, encodedBatch);
 }
 
-void RpcConnection::sendResponseSuccess(QVariant data)
+void RpcConnection::sendForwardedSignal(const QByteArray &command, const QVariantList &arguments)
 {
-    sendResponse(NoError, data);
+    if(signalBatchDelay == -1) {
+        sendCommandAsync(command, arguments);
+        return;
+    }
+    signalBatch << QVariant(QVariantList() << QString::fromUtf8(command) << QVariant(arguments));
+    if(!signalBatchTimer.isActive())
+        signalBatchTimer.start(signalBatchDelay, this);
 }
 
-void RpcConnection::sendResponseParseError(QByteArray commandLine)
+void RpcConnection::sendSignalBatch()
 {
-    sendResponse(ParseError, QVariant("Error parsing command: " + commandLine));
+    signalBatchTimer.stop();
+    QVariantList batch = signalBatch;
+    signalBatch.clear();
+    if(batch.isEmpty())
+        return;
+
+    // a single signal is cheaper as a plain asynchronous command
+    if(batch.count() == 1)
+    {
+        QVariantList call = batch.first().toList();
+        sendCommandAsync(call.at(0).toString().toUtf8(), call.at(1).toList());
+        return;
+    }
+
+    quint8 flags = 0;
+    bool ok = false;
+    QByteArray encodedBatch = outgoingCodec(&flags)->encode(batch, false, &ok);
+    if(ok)
+        sendMessage(AsyncBatchMessage, flags, 0, QByteArray(), encodedBatch);
 }
 
-void RpcConnection::sendResponseCommandDoesntExistError(QByteArray commandName)
+void RpcConnection::sendResponse(quint32 requestId, ErrorCode errorCode, QVariant data)
 {
-    sendResponse(SystemError, QVariant("No such command: " + commandName));
+    quint8 flags = 0;
+    QByteArray encodedData = outgoingCodec(&flags)->encode(data, true, 0);
+    sendMessage(ResponseMessage, flags, requestId, QByteArray::number(errorCode), encodedData);
 }
 
-void RpcConnection::sendResponseCommandSignatureMismatchError(QByteArray commandName)
+void RpcConnection::sendCommandResponse(quint32 requestId, const QByteArray &commandName,
+                                        const RpcCommandMapper::CommandResult &result, const QByteArray &cacheKey)
 {
-    sendResponse(SystemError, QVariant("Signature mismatch for command " + commandName));
+    QVariant data;
+    ErrorCode errorCode = processCommandResult(commandName, result, &data);
+    if(errorCode != NoError || cacheKey.isEmpty()) {
+        sendResponse(requestId, errorCode, data);
+        return;
+    }
+
+    // keep the encoded result for the next call with the same arguments
+    quint8 flags = 0;
+    bool ok = false;
+    RpcCodec *codec = outgoingCodec(&flags);
+    QByteArray encodedData = codec->encode(data, true, &ok);
+    if(ok)
+        commandMapper->storeCachedResponse(codec->name() + ' ' + cacheKey, encodedData);
+    sendMessage(ResponseMessage, flags, requestId, QByteArray::number(NoError), encodedData);
 }
 
+void RpcConnection::sendResponseSuccess(quint32 requestId, QVariant data)
+{
+    sendResponse(requestId, NoError, data);
+}
 
+void RpcConnection::sendResponseParseError(quint32 requestId, QByteArray commandLine)
+{
+    sendResponse(requestId, ParseError, QVariant("Error parsing command: " + commandLine));
+}
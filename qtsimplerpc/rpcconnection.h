@@ -29,24 +29,220 @@
 #include <QEventLoop>
 #include <QMetaObject>
 #include <QMetaMethod>
+#include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QPointer>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QPair>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QFutureWatcher>
+#include <QCache>
+#include "rpccommandmapper.h"
+#include "rpcstreamwriter.h"
 
 class QIODevice;
-class RpcCommandMapper;
 class RpcSignalMapper;
+class RpcCodec;
+class RpcCompressor;
+struct RpcResponseChannel;
+class RpcCommandJob;
+class RpcExecutor;
 
 class RpcConnection : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(QIODevice* peerDevice READ peerDevice WRITE setPeerDevice)
 
+public:
     enum ErrorCode {
         NoError = 0,
         SystemError = 1,
-        ParseError = 2
+        ParseError = 2,
+        MessageTooLargeError = 3,
+        //! The call's deadline passed before the response arrived
+        TimeoutError = 4,
+        //! The call has been canceled using cancelCall()
+        CanceledError = 5,
+        //! The remote end's executor queue was full
+        BusyError = 6
     };
 
-public:
-    explicit RpcConnection(QObject *parent = 0);
+    enum FramingMode {
+        //! Newline delimited text messages. This is the default and is
+        //! understood by every peer.
+        LineFraming,
+        //! Messages with a fixed size header (payload length, message type,
+        //! flags, request ID). The payload may contain any bytes and the
+        //! reader never has to scan for a delimiter.
+        BinaryFraming
+    };
+
+    //! What happens to signals forwarded as commands while the connection is congested
+    enum SignalCongestionPolicy {
+        //! Wait until the device has written enough data, for at most one
+        //! second; conflate the signal if it's still congested. This blocks
+        //! the emitting thread, so it has to be chosen explicitly.
+        BlockSignals,
+        //! Don't forward the signal
+        DropSignals,
+        //! Only keep the latest arguments per command and forward them once
+        //! drained (default)
+        ConflateSignals
+    };
+
+    //! Commands are mapped on \arg sharedCommandMapper (not owned) instead of
+    //! an own mapper if given; such a connection can't map commands itself.
+    explicit RpcConnection(QObject *parent = 0, RpcCommandMapper *sharedCommandMapper = 0);
+    ~RpcConnection();
+
+    //! Switches the framing of outgoing messages and asks the peer to do the
+    //! same. Both peers must support the requested mode. Call this after the
+    //! peer device has been set. Like all negotiation, the request waits
+    //! until the peer has announced that it understands control messages,
+    //! and is ignored for older peers which don't.
+    void setFramingMode(FramingMode mode);
+    FramingMode framingMode() const;
+
+    //! Asks the peer to encode arguments and results with the named codec
+    //! (see RpcCodec), in both directions. Codecs other than "json" require
+    //! binary framing. Until the peer has accepted the codec, JSON is used.
+    void setCodec(const QByteArray &codecName);
+    QByteArray codec() const;
+
+    //! Asks the peer to compress frames with the named compressor (see
+    //! RpcCompressor), in both directions, or "none" to stop compression. Only
+    //! frames of at least \arg threshold bytes are compressed, which is decided
+    //! by each peer on its own. Requires binary framing.
+    void setCompression(const QByteArray &compressorName, int threshold = 1024);
+    QByteArray compression() const;
+
+    //! Lets the peer switch to binary framing, or the named codec or
+    //! compressor, on its own request. Nothing is accepted by default; other
+    //! requests are refused. Setting a mode, codec or compressor ourselves
+    //! accepts it, too.
+    void setBinaryFramingAccepted(bool accepted);
+    void setCodecAccepted(const QByteArray &codecName, bool accepted = true);
+    void setCompressionAccepted(const QByteArray &compressorName, bool accepted = true);
+
+    //! Incoming messages larger than \arg bytes (default 64 MiB, 0 for the
+    //! largest size a buffer can hold, 1 GiB) are dropped while they arrive,
+    //! without buffering them. Oversized commands are answered with an error,
+    //! calls with an oversized response fail. Large commands in line framing
+    //! are decoded while they arrive, so their text isn't buffered either.
+    void setMaximumMessageSize(int bytes);
+    int maximumMessageSize() const;
+    //! The read buffer is kept for the next message if it's not larger than
+    //! \arg bytes (default 64 KiB). 0 releases it whenever it runs empty,
+    //! which keeps idle connections small.
+    void setMaximumIdleReadBufferSize(int bytes);
+
+    //! Outgoing messages are collected and written to the device at once
+    //! \arg msec after the first one has been queued (0 means in the next
+    //! event loop iteration, which is the default).
+    void setWriteCoalescingDelay(int msec);
+    int writeCoalescingDelay() const;
+    //! Collected messages are written immediately once they reach \arg bytes
+    //! (default 64 KiB). 0 writes every message immediately.
+    void setWriteBufferThreshold(int bytes);
+    int writeBufferThreshold() const;
+
+    //! The connection is congested once the outgoing data not yet written by
+    //! the device reaches \arg high bytes, and drained again once it falls to
+    //! \arg low bytes (defaults: 4 MiB / 1 MiB). 0 disables flow control.
+    void setWriteWatermarks(int high, int low);
+    bool isCongested() const;
+    void setSignalCongestionPolicy(SignalCongestionPolicy policy);
+    SignalCongestionPolicy signalCongestionPolicy() const;
+    //! Signals forwarded as asynchronous commands are collected for \arg msec
+    //! (0 means until the next event loop iteration) and sent as a single
+    //! message, which the peer runs in order. -1, the default, sends each
+    //! signal right away. The peer must support asynchronous batches.
+    void setSignalBatchWindow(int msec);
+    int signalBatchWindow() const;
+    //! Only forwards signals mapped to commands the peer has subscribed to,
+    //! others are ignored before their arguments are converted. Asks the
+    //! peer for its subscriptions, no signals are forwarded until they
+    //! arrive. The peer must support subscriptions.
+    void setSignalSubscriptionEnabled(bool enabled);
+    bool isSignalSubscriptionEnabled() const;
+
+    //! Calls command on the remote end without blocking. The returned future
+    //! is resolved when the response arrives. If the remote end reports an
+    //! error, the future is canceled and its result holds the error message.
+    //! The request ID for cancelCall() is stored in \arg requestId.
+    QFuture<QVariant> remoteCallFuture(QByteArray command, QVariantList arguments, int timeout = -1, quint32 *requestId = 0);
+    //! Calls command on the remote end without blocking. When the response
+    //! arrives, \arg member of \arg receiver is invoked with the arguments
+    //! (QVariant result, int errorCode). Returns the request ID for cancelCall().
+    quint32 remoteCallWithCallback(QByteArray command, QVariantList arguments, QObject *receiver, const char *member, int timeout = -1);
+    //! Calls a streaming command (see RpcStreamWriter) on the remote end
+    //! without blocking. Each chunk is passed to \arg chunkMember of \arg
+    //! receiver (QVariant chunk) as it arrives, the end of the stream to
+    //! \arg finishedMember (QVariant result, int errorCode). The remote end
+    //! sends at most \arg window chunks ahead of the ones delivered.
+    //! Returns the request ID for cancelCall().
+    quint32 remoteCallStream(QByteArray command, QVariantList arguments, QObject *receiver,
+                             const char *chunkMember, const char *finishedMember, int window = 16, int timeout = -1);
+
+    //! Calls fail with TimeoutError if their response doesn't arrive within
+    //! \arg msec (0, the default, waits forever). A \arg timeout of -1 passed
+    //! to the remote call methods uses this default. The timeout is sent along
+    //! with the command, so the remote end can skip work nobody waits for.
+    void setDefaultCallTimeout(int msec);
+    int defaultCallTimeout() const;
+
+    //! Runs commands of the remote end on the global thread pool instead of
+    //! the reading thread and answers each one as soon as it's done, so a
+    //! slow command doesn't hold up the following ones. Peers not tagging
+    //! commands with a request ID expect responses in order, so answers to
+    //! their commands are held back until the ones before have been sent.
+    //! The mapped objects must be thread-safe.
+    void setParallelDispatchEnabled(bool enabled);
+    bool isParallelDispatchEnabled() const;
+    //! Ordered commands run one after another in the order they arrived,
+    //! see RpcCommandMapper::setCommandOrdered()
+    void setCommandOrdered(const QByteArray &commandName, bool ordered = true);
+    //! Server side: the encoded responses of \arg commandName are cached and
+    //! sent again for the same arguments the remote end calls it with, see
+    //! RpcCommandMapper::setCommandResponseCacheable(). The results of our
+    //! own calls are cached with setCommandResultCacheable().
+    void setCommandResponseCacheable(const QByteArray &commandName, bool cacheable = true);
+    void setResponseCacheSize(int bytes);
+    //! Commands run in parallel and asynchronous commands are run by
+    //! \arg executor (not owned) instead of the global thread pool if set
+    void setExecutor(RpcExecutor *executor);
+    RpcExecutor *executor() const;
+    //! Runs commands of the remote end in the thread of the object they are
+    //! mapped to, through that thread's event loop, and answers them when
+    //! done. Objects living in different threads then serve calls in parallel
+    //! without having to be thread-safe. Takes precedence over the executor.
+    //! Answers to untagged commands are held back until the ones before have
+    //! been sent. The threads need a running event loop: commands of objects
+    //! in a thread that isn't running fail with SystemError (asynchronous ones
+    //! are dropped), while those sent to a thread running without an event
+    //! loop are never answered.
+    void setThreadAffineDispatchEnabled(bool enabled);
+    bool isThreadAffineDispatchEnabled() const;
+
+    //! Keeps the results of cacheable commands (see setCommandResultCacheable()) for
+    //! up to \arg entries distinct calls, evicting the least recently used
+    //! ones. Calls answered from the cache don't reach the remote end. 0, the
+    //! default, disables the cache.
+    void setResultCacheSize(int entries);
+    int resultCacheSize() const;
+    //! Successful results of \arg commandName are cached per arguments for
+    //! \arg ttl msec (0 keeps them until invalidated). Only use this for
+    //! commands without side effects.
+    void setCommandResultCacheable(const QByteArray &commandName, bool cacheable = true, int ttl = 0);
+    //! Drops the cached results of \arg cachedCommand whenever the remote end
+    //! calls \arg incomingCommand, for example a signal it forwards when the
+    //! underlying data has changed
+    void setCacheInvalidatedBy(const QByteArray &incomingCommand, const QByteArray &cachedCommand);
 
 public slots:
     void setPeerDevice(QIODevice *peerDevice);
@@ -62,44 +258,296 @@ public slots:
     void mapSignalToCommand(QObject *object, const char *signal, const QByteArray &commandName);
     void mapAllSignalsToCommands(QObject *object);
 
+    //! Tells a peer which asked for our subscriptions that we do (or don't)
+    //! want it to forward signals mapped to \arg commandName anymore.
+    //! Mapped commands are subscribed automatically.
+    void subscribeCommand(const QByteArray &commandName);
+    void unsubscribeCommand(const QByteArray &commandName);
+    //! Conflation of forwarded signals, see RpcSignalMapper::setConflationWindow()
+    //! and RpcSignalMapper::setMinimumInterval(). The signal has to be mapped first.
+    void setSignalConflationWindow(QObject *object, const char *signal, int window, int keyArgument = -1);
+    void setSignalMinimumInterval(QObject *object, const char *signal, int interval, int keyArgument = -1);
+
     //! Calls command on the remote end
-    QVariant remoteCall(QByteArray command, QVariantList arguments, int *errorCode = 0);
+    QVariant remoteCall(QByteArray command, QVariantList arguments, int *errorCode = 0, int timeout = -1);
+    //! Calls several commands on the remote end using a single message and
+    //! waits for all of them. Returns the result of each call in order; their
+    //! error codes are stored in \arg errorCodes.
+    QVariantList remoteCallBatch(QList<QPair<QByteArray, QVariantList> > calls, QList<int> *errorCodes = 0, int timeout = -1);
     //! Calls command asynchronously on the remote end
     void remoteCallAsync(QByteArray command, QVariantList arguments);
 
+    //! Fails the pending call with CanceledError and tells the remote end
+    void cancelCall(quint32 requestId);
+    void cancelAllCalls();
+
+    //! Drops the cached results of \arg commandName, or all if empty
+    void invalidateCachedResults(const QByteArray &commandName = QByteArray());
+
     //! Registers all enums registered as meta enums using Q_ENUMS() macro within the class definition
     static void registerEnums(const QMetaObject *metaObject);
 
+    //! Writes all collected outgoing messages to the device now
+    void flushNow();
+
 signals:
     //! Emitted when the device should be flushed when supported (for example QTcpSocket::flush())
     void deviceFlush();
+    //! Emitted when the outgoing data reaches the high watermark
+    void congested();
+    //! Emitted when the outgoing data falls back to the low watermark
+    void drained();
+
+protected:
+    void timerEvent(QTimerEvent *event);
+    bool event(QEvent *event);
 
 private slots:
     void device_readyRead();
+    void device_bytesWritten();
+    void forwardSignal(QByteArray command, QVariantList arguments);
+    void deferredFuture_finished();
 
 private:
-    QIODevice *device;
+    //! Guarded, the device may be deleted before the connection
+    QPointer<QIODevice> device;
+    //! Read buffer storage. Its size is the capacity, the received but not yet
+    //! processed data is [readPos, readEnd). With line framing, scanPos is
+    //! where the search for the next delimiter continues.
     QByteArray readBuf;
+    int readPos;
+    int readEnd;
+    int scanPos;
+    //! Incoming messages exceeding maxMessageSize are skipped: the remaining
+    //! bytes of a binary frame, or everything up to the next line delimiter.
+    int maxMessageSize;
+    int maxIdleReadBufferSize;
+    qint64 skipFrameBytes;
+    bool skipLine;
+    //! A large command line decoded while it arrives, 0 if none
+    struct StreamedCommand;
+    StreamedCommand *streamedCommand;
+    FramingMode readFraming;
+    FramingMode writeFraming;
+    bool framingRequested;
+    bool binaryFramingAccepted;
+    QSet<QByteArray> acceptedCodecs;
+    QSet<QByteArray> acceptedCompressors;
+    //! Codecs used by the peer and by us for frames with the codec flag (0
+    //! for JSON) and codec we asked the peer for. Same for compressors.
+    RpcCodec *readCodec;
+    RpcCodec *writeCodec;
+    RpcCodec *requestedCodec;
+    RpcCompressor *readCompressor;
+    RpcCompressor *writeCompressor;
+    QByteArray requestedCompression;
+    int compressionThreshold;
+    QByteArray writeBuf;
+    QBasicTimer flushTimer;
+    int flushDelay;
+    int flushThreshold;
+    int highWatermark;
+    int lowWatermark;
+    bool writeCongested;
+    SignalCongestionPolicy congestionPolicy;
+    //! Latest arguments of signals conflated while congested, in order of first emission
+    QHash<QByteArray, QVariantList> conflatedSignals;
+    QList<QByteArray> conflatedSignalOrder;
+    //! Forwarded signals collected for the next asynchronous batch
+    QVariantList signalBatch;
+    QBasicTimer signalBatchTimer;
+    int signalBatchDelay;
+    //! Commands the peer subscribed to, used if signalSubscription is set
+    bool signalSubscription;
+    QSet<QByteArray> subscribedCommands;
+    //! The peer filters the signals it forwards by our subscriptions
+    bool peerWantsSubscriptions;
     RpcCommandMapper *commandMapper;
+    bool ownCommandMapper;
     RpcSignalMapper *signalMapper;
-    QEventLoop responseLoop;
-    QVariant availableResponse;
-    int availableErrorCode;
+    bool parallelDispatch;
+    RpcExecutor *commandExecutor;
+    bool threadAffineDispatch;
+    //! Commands running in parallel answer through this, created on demand
+    QSharedPointer<RpcResponseChannel> responseChannel;
+    //! Ordered commands waiting for the one running before them
+    QQueue<RpcCommandJob *> orderedJobs;
+    bool orderedJobRunning;
+    //! Reading stops while the executor's queue is full (see RpcExecutor::BlockReader)
+    bool readPaused;
+    qint64 pausedReadBufferSize;
+    //! Request IDs of commands answered when their returned future finishes
+    QHash<QFutureWatcherBase *, quint32> deferredFutures;
+    //! Streams sent by our commands. Callers not reading streams get the chunks collected.
+    struct OutgoingStream {
+        RpcStreamWriter writer;
+        bool streaming;
+        QVariantList collected;
+    };
+    QHash<quint32, OutgoingStream> outgoingStreams;
+
+    //! A call waiting for its response. A synchronous call spins its own
+    //! event loop (so calls can be nested and responses may arrive in any
+    //! order) and owns its entry. Asynchronous calls are heap allocated and
+    //! resolve their future or callback when completed.
+    struct PendingCall {
+        QEventLoop *loop;
+        bool hasFuture;
+        QFutureInterface<QVariant> future;
+        QPointer<QObject> receiver;
+        QByteArray member;
+        //! Streaming calls: chunk callback, credit window and chunks delivered since the last credit
+        QByteArray chunkMember;
+        int streamWindow;
+        int chunksDelivered;
+        QVariant response;
+        int errorCode;
+        bool finished;
+        quint32 requestId;
+        //! Sent with its request ID, so the peer may answer it out of order
+        bool tagged;
+        qint64 deadline;
+        //! Calls of cacheable commands store their result under this key,
+        //! unless the cache has been invalidated since they were sent
+        QByteArray cacheKey;
+        quint32 cacheGeneration;
+
+        inline PendingCall() : loop(0), hasFuture(false), streamWindow(0), chunksDelivered(0), errorCode(0), finished(false), requestId(0), tagged(false), deadline(-1), cacheGeneration(0) {}
+    };
+    //! Outstanding calls by request ID; calls sent untagged are resolved
+    //! through untaggedCalls instead.
+    QMap<quint32, PendingCall *> pendingCalls;
+    quint32 nextRequestId;
+    //! Whether the peer has announced to understand request IDs
+    enum PeerTagging {
+        TaggingUnknown,
+        TaggingSupported,
+        TaggingUnsupported
+    };
+    PeerTagging peerTagging;
+    //! Requests to negotiate framing, codec, compression or subscriptions
+    //! (control message name and value) waiting for the peer's announcement
+    QList<QPair<QByteArray, QByteArray> > deferredNegotiation;
+    //! Whether a peer device has been set before, whose peer got our messages
+    bool hadPeerDevice;
+    //! Request IDs of calls sent untagged, in order, answered in this order
+    QQueue<quint32> untaggedCalls;
+    //! Untagged commands of the peer get internal IDs to be answered in the
+    //! order they arrived; responses ready early are held until it's their turn
+    quint32 nextUntaggedResponseId;
+    QQueue<quint32> untaggedResponseOrder;
+    QHash<quint32, QByteArray> heldUntaggedResponses;
+    //! Request IDs of pending calls by deadline (msecs of clock)
+    QMultiMap<qint64, quint32> callDeadlines;
+    QBasicTimer timeoutTimer;
+    QElapsedTimer clock;
+    int defaultTimeout;
 
-    QVariant waitForResponse(int *errorCode);
+    //! Results of cacheable commands by resultCacheKey(), expiry in msecs of clock (-1 for none)
+    struct CachedResult {
+        QVariant result;
+        qint64 expiry;
+    };
+    QCache<QByteArray, CachedResult> resultCache;
+    //! Time to live of the results of cacheable commands
+    QHash<QByteArray, int> cacheableCommands;
+    //! Cached commands by the incoming commands invalidating them
+    QMultiHash<QByteArray, QByteArray> cacheInvalidations;
+    quint32 cacheGeneration;
+
+    QByteArray resultCacheKey(const QByteArray &command, const QVariantList &arguments) const;
+    bool findCachedResult(const QByteArray &key, QVariant *result);
+    void storeCachedResult(PendingCall *call, const QVariant &result);
+    void invalidateCachesFor(const QByteArray &incomingCommand);
+    //! Queues a negotiation request until the peer has announced that it
+    //! understands control messages; true if it mustn't be sent now
+    bool deferNegotiation(const QByteArray &name, const QByteArray &value);
+    //! Settles what the peer understands, sending or dropping deferred requests
+    void setPeerTagging(PeerTagging tagging);
+    void announceSubscriptions();
+
+    quint32 newRequestId();
+    quint32 untaggedResponseId();
+    int effectiveTimeout(int timeout) const;
+    quint32 registerCall(PendingCall *call, int timeout);
+    PendingCall *takePendingCall(quint32 requestId);
+    void scheduleTimeouts();
+    void expireCalls();
+    QVariant waitForResponse(PendingCall *call, int *errorCode);
+    void completeCall(PendingCall *call, int errorCode, const QVariant &response);
+
+    enum MessageType {
+        CommandMessage = 1,
+        AsyncCommandMessage = 2,
+        ResponseMessage = 3,
+        ControlMessage = 4,
+        BatchMessage = 5,
+        StreamChunkMessage = 6,
+        AsyncBatchMessage = 7
+    };
+    enum FrameFlag {
+        //! The payload is encoded with the negotiated codec instead of JSON
+        CodecFrameFlag = 0x01,
+        //! The payload is compressed with the negotiated compressor
+        CompressedFrameFlag = 0x02
+    };
+
+    RpcCodec *outgoingCodec(quint8 *flags) const;
+    RpcCodec *incomingCodec(quint8 flags) const;
+    qint64 pendingWriteSize() const;
+    void updateCongestion();
+
+    bool fillReadBuffer();
+    void processReadBuffer();
+    int messageSizeLimit() const;
+    void pauseReading();
+    void resumeReading();
+    void compactReadBuffer();
+    void reserveReadBuffer(int size);
+    void rejectOversizedLine(const QByteArray &start);
+    void rejectOversizedMessage(MessageType type, quint32 requestId);
 
     void processRawMessage(QByteArray message);
-    void processRawCommand(QByteArray command);
-    void processRawResponse(QByteArray response);
+    void processFrame(MessageType type, quint8 flags, quint32 requestId, QByteArray payload);
+    void processRawCommand(quint32 requestId, bool async, quint8 flags, QByteArray command);
+    bool startStreamedCommand();
+    void finishStreamedCommand();
+    void executeCommand(quint32 requestId, bool async, const QByteArray &commandName, const QVariantList &arguments,
+                        int timeout, int streamWindow, const QByteArray &cacheKey);
+    void processRawBatch(quint32 requestId, quint8 flags, QByteArray batch);
+    void processRawAsyncBatch(quint8 flags, QByteArray batch);
+    void runCommandAsync(const QByteArray &commandName, const QVariantList &arguments, int timeout);
+    static void runCommandsInOrder(RpcCommandMapper *commandMapper, QList<QPair<QByteArray, QVariantList> > commands);
+    bool deferResponse(quint32 requestId, const RpcCommandMapper::CommandResult &result, int streamWindow);
+    void sendStreamChunks(quint32 requestId);
+    void processRawChunk(quint32 requestId, quint8 flags, QByteArray chunkData);
+    ErrorCode processCommandResult(const QByteArray &commandName, const RpcCommandMapper::CommandResult &result, QVariant *data);
+    void processRawResponse(quint32 requestId, ErrorCode errorCode, quint8 flags, QByteArray result);
+    void processControlMessage(QByteArray message);
+    void ensureResponseChannel();
+    void dispatchCommand(RpcCommandJob *job);
+    bool startJob(RpcCommandJob *job);
+    void startNextOrderedJob();
 
+    void sendMessage(MessageType type, quint8 flags, quint32 requestId, const QByteArray &head, const QByteArray &body);
     void sendRawMessage(QByteArray message);
-    void sendCommand(QByteArray command, QVariantList arguments);
+    void sendControlMessage(const QByteArray &name, const QByteArray &value);
+    static int takeNumberPrefix(QByteArray *data, char marker);
+    static QByteArray methodName(const char *member);
+
+    void sendCommand(quint32 requestId, QByteArray command, QVariantList arguments, int timeout, int streamWindow = 0);
     void sendCommandAsync(QByteArray command, QVariantList arguments);
-    void sendResponse(ErrorCode errorCode, QVariant data);
-    void sendResponseSuccess(QVariant data);
-    void sendResponseParseError(QByteArray commandLine);
-    void sendResponseCommandDoesntExistError(QByteArray commandName);
-    void sendResponseCommandSignatureMismatchError(QByteArray commandName);
+    void sendCommandMessage(MessageType type, quint32 requestId, QByteArray command, QVariantList arguments);
+    void sendBatch(quint32 requestId, QVariantList batch, int timeout);
+    void sendForwardedSignal(const QByteArray &command, const QVariantList &arguments);
+    void conflateSignal(const QByteArray &command, const QVariantList &arguments);
+    void sendSignalBatch();
+    void sendResponse(quint32 requestId, ErrorCode errorCode, QVariant data);
+    //! Answers a command with its result, caching the encoded response if \arg cacheKey is set
+    void sendCommandResponse(quint32 requestId, const QByteArray &commandName,
+                             const RpcCommandMapper::CommandResult &result, const QByteArray &cacheKey);
+    void sendResponseSuccess(quint32 requestId, QVariant data);
+    void sendResponseParseError(quint32 requestId, QByteArray commandLine);
 };
 
 #endif // RPCCONNECTION_H
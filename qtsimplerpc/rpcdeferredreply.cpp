@@ -0,0 +1,113 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include "rpcdeferredreply.h"
+
+#include <QMutex>
+
+
+class RpcDeferredReplyData
+{
+public:
+    QMutex mutex;
+    bool finished;
+    bool successful;
+    QVariant result;
+    RpcDeferredReplyTarget *target;
+
+    RpcDeferredReplyData() : finished(false), successful(false), target(0) {}
+
+    ~RpcDeferredReplyData()
+    {
+        // the last handle is gone without a reply, don't leave the caller waiting
+        if(target && !finished)
+            target->deliver(false, QVariant("Command finished without reply"));
+        delete target;
+    }
+};
+
+
+RpcDeferredReply::RpcDeferredReply()
+{
+}
+
+RpcDeferredReply RpcDeferredReply::create()
+{
+    RpcDeferredReply reply;
+    reply.d = QSharedPointer<RpcDeferredReplyData>(new RpcDeferredReplyData);
+    return reply;
+}
+
+bool RpcDeferredReply::isValid() const
+{
+    return !d.isNull();
+}
+
+bool RpcDeferredReply::isFinished() const
+{
+    if(!d)
+        return false;
+    QMutexLocker locker(&d->mutex);
+    return d->finished;
+}
+
+void RpcDeferredReply::finish(const QVariant &result)
+{
+    complete(true, result);
+}
+
+void RpcDeferredReply::fail(const QString &errorMessage)
+{
+    complete(false, QVariant(errorMessage));
+}
+
+void RpcDeferredReply::setTarget(RpcDeferredReplyTarget *target)
+{
+    if(!d) {
+        delete target;
+        return;
+    }
+
+    QMutexLocker locker(&d->mutex);
+    delete d->target;
+    d->target = target;
+    if(d->finished)
+        target->deliver(d->successful, d->result);
+}
+
+void RpcDeferredReply::complete(bool successful, const QVariant &result)
+{
+    if(!d)
+        return;
+
+    QMutexLocker locker(&d->mutex);
+    if(d->finished)
+        return;
+    d->finished = true;
+    d->successful = successful;
+    if(d->target)
+        d->target->deliver(successful, result);
+    else
+        d->result = result; // kept until the connection takes over
+}
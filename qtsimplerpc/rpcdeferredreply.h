@@ -0,0 +1,80 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#ifndef RPCDEFERREDREPLY_H
+#define RPCDEFERREDREPLY_H
+
+#include <qtsimplerpc_global.h>
+
+#include <QVariant>
+#include <QSharedPointer>
+#include <QMetaType>
+#include <QFuture>
+
+class RpcDeferredReplyData;
+
+//! Receives the reply to a deferred command and sends it as the response
+class RpcDeferredReplyTarget
+{
+public:
+    virtual ~RpcDeferredReplyTarget() {}
+    //! Called once, from the thread finishing the reply
+    virtual void deliver(bool successful, const QVariant &result) = 0;
+};
+
+//! Lets a command answer later. A slot taking an RpcDeferredReply as its
+//! last parameter (the remote end doesn't pass it) gets a handle for its
+//! call and returns without a result; the response is sent once finish() or
+//! fail() is called on any copy of the handle, from any thread. Slots may
+//! also return a QFuture<QVariant>, which is answered when it finishes.
+//! Either way the connection isn't blocked while the command is pending.
+class QTSIMPLERPC_EXPORT RpcDeferredReply
+{
+public:
+    //! Creates a handle which isn't attached to a call
+    RpcDeferredReply();
+    static RpcDeferredReply create();
+
+    bool isValid() const;
+    bool isFinished() const;
+
+    //! Sends \arg result as the response. Only the first finish() or fail() counts.
+    void finish(const QVariant &result);
+    //! Answers with an error
+    void fail(const QString &errorMessage);
+
+    //! Hands the reply over to \arg target (taking ownership), right away if
+    //! it has already been finished
+    void setTarget(RpcDeferredReplyTarget *target);
+
+private:
+    QSharedPointer<RpcDeferredReplyData> d;
+
+    void complete(bool successful, const QVariant &result);
+};
+
+Q_DECLARE_METATYPE(RpcDeferredReply)
+Q_DECLARE_METATYPE(QFuture<QVariant>)
+
+#endif // RPCDEFERREDREPLY_H
@@ -0,0 +1,213 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include "rpcexecutor.h"
+
+#include <QRunnable>
+#include <QThread>
+
+
+//! Runs a queued job and frees its thread for the next one
+class RpcExecutorTask : public QRunnable
+{
+public:
+    RpcExecutorTask(RpcExecutor *executor, QRunnable *job) : executor(executor), job(job) {}
+
+    void run()
+    {
+        // the job may delete itself
+        bool deleteJob = job->autoDelete();
+        job->run();
+        if(deleteJob)
+            delete job;
+        executor->jobFinished();
+    }
+
+private:
+    RpcExecutor *executor;
+    QRunnable *job;
+};
+
+
+RpcExecutor::RpcExecutor() :
+    reservedThreads(1),
+    maxQueueDepth(0),
+    overflow(RejectBusy),
+    running(0)
+{
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+RpcExecutor::~RpcExecutor()
+{
+    {
+        QMutexLocker locker(&mutex);
+        for(int lane = HighPriority; lane >= LowPriority; --lane)
+            while(!lanes[lane].isEmpty()) {
+                ++running;
+                pool.start(new RpcExecutorTask(this, lanes[lane].dequeue()));
+            }
+        // nobody reads from connections using a deleted executor
+        qDeleteAll(listeners);
+        listeners.clear();
+    }
+    pool.waitForDone();
+}
+
+void RpcExecutor::setMaxThreadCount(int count)
+{
+    QMutexLocker locker(&mutex);
+    pool.setMaxThreadCount(qMax(count, 1));
+    scheduleJobs();
+}
+
+int RpcExecutor::maxThreadCount() const
+{
+    return pool.maxThreadCount();
+}
+
+void RpcExecutor::setReservedThreadCount(int count)
+{
+    QMutexLocker locker(&mutex);
+    reservedThreads = qMax(count, 0);
+    scheduleJobs();
+}
+
+int RpcExecutor::reservedThreadCount() const
+{
+    QMutexLocker locker(&mutex);
+    return reservedThreads;
+}
+
+void RpcExecutor::setMaximumQueueDepth(int commands)
+{
+    QMutexLocker locker(&mutex);
+    maxQueueDepth = qMax(commands, 0);
+    notifyListeners();
+}
+
+int RpcExecutor::maximumQueueDepth() const
+{
+    QMutexLocker locker(&mutex);
+    return maxQueueDepth;
+}
+
+void RpcExecutor::setOverflowPolicy(OverflowPolicy policy)
+{
+    QMutexLocker locker(&mutex);
+    overflow = policy;
+    notifyListeners();
+}
+
+RpcExecutor::OverflowPolicy RpcExecutor::overflowPolicy() const
+{
+    QMutexLocker locker(&mutex);
+    return overflow;
+}
+
+void RpcExecutor::setCommandPriority(const QByteArray &commandName, Priority priority)
+{
+    QMutexLocker locker(&mutex);
+    if(priority == NormalPriority)
+        commandPriorities.remove(commandName);
+    else
+        commandPriorities.insert(commandName, priority);
+}
+
+RpcExecutor::Priority RpcExecutor::commandPriority(const QByteArray &commandName) const
+{
+    QMutexLocker locker(&mutex);
+    return commandPriorities.value(commandName, NormalPriority);
+}
+
+bool RpcExecutor::submit(QRunnable *job, Priority priority)
+{
+    // with BlockReader, the connection stops reading once it sees the queue full
+    QMutexLocker locker(&mutex);
+    if(priority != HighPriority && overflow == RejectBusy && maxQueueDepth && queueDepth() >= maxQueueDepth)
+        return false;
+    lanes[priority].enqueue(job);
+    scheduleJobs();
+    return true;
+}
+
+bool RpcExecutor::isQueueFull() const
+{
+    QMutexLocker locker(&mutex);
+    return maxQueueDepth && queueDepth() >= maxQueueDepth;
+}
+
+void RpcExecutor::notifyWhenNotFull(RpcExecutorListener *listener)
+{
+    QMutexLocker locker(&mutex);
+    listeners << listener;
+    notifyListeners();
+}
+
+int RpcExecutor::queueDepth() const
+{
+    return lanes[LowPriority].count() + lanes[NormalPriority].count();
+}
+
+void RpcExecutor::notifyListeners()
+{
+    if(listeners.isEmpty() || (maxQueueDepth && queueDepth() >= maxQueueDepth && overflow == BlockReader))
+        return;
+    foreach(RpcExecutorListener *listener, listeners)
+    {
+        listener->queueNotFull();
+        delete listener;
+    }
+    listeners.clear();
+}
+
+void RpcExecutor::scheduleJobs()
+{
+    // the pool never queues itself, so a free thread is taken by the highest lane
+    int threads = pool.maxThreadCount();
+    int bulkThreads = qMax(threads - reservedThreads, 1);
+    forever
+    {
+        QQueue<QRunnable *> *lane = 0;
+        if(running < threads && !lanes[HighPriority].isEmpty())
+            lane = &lanes[HighPriority];
+        else if(running < bulkThreads && !lanes[NormalPriority].isEmpty())
+            lane = &lanes[NormalPriority];
+        else if(running < bulkThreads && !lanes[LowPriority].isEmpty())
+            lane = &lanes[LowPriority];
+        if(!lane)
+            break;
+
+        ++running;
+        pool.start(new RpcExecutorTask(this, lane->dequeue()));
+    }
+    notifyListeners();
+}
+
+void RpcExecutor::jobFinished()
+{
+    QMutexLocker locker(&mutex);
+    --running;
+    scheduleJobs();
+}
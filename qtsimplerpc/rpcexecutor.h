@@ -0,0 +1,123 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#ifndef RPCEXECUTOR_H
+#define RPCEXECUTOR_H
+
+#include <qtsimplerpc_global.h>
+
+#include <QThreadPool>
+#include <QMutex>
+#include <QQueue>
+#include <QHash>
+#include <QList>
+
+class QRunnable;
+
+//! Is told when the queue of an RpcExecutor has room again
+class RpcExecutorListener
+{
+public:
+    virtual ~RpcExecutorListener() {}
+    //! Called once, from any thread
+    virtual void queueNotFull() = 0;
+};
+
+//! Runs the commands of one or more connections (see
+//! RpcConnection::setExecutor()) on its own thread pool, isolated from the
+//! rest of the application. Commands are queued in one lane per priority;
+//! high priority commands are taken first, may use threads kept free of
+//! the other lanes and are never rejected, so cheap control commands don't
+//! wait behind bulk jobs. All methods are thread-safe.
+class QTSIMPLERPC_EXPORT RpcExecutor
+{
+public:
+    enum Priority {
+        LowPriority,
+        NormalPriority,
+        HighPriority
+    };
+
+    //! What happens to a command arriving while the queue is full
+    enum OverflowPolicy {
+        //! Answer it with RpcConnection::BusyError
+        RejectBusy,
+        //! Queue it anyway, but stop reading from the connection until the
+        //! queue has room (the connection's thread is never blocked)
+        BlockReader
+    };
+
+    RpcExecutor();
+    //! Runs the commands still queued and waits for them
+    ~RpcExecutor();
+
+    //! Defaults to QThread::idealThreadCount()
+    void setMaxThreadCount(int count);
+    int maxThreadCount() const;
+    //! Threads only high priority commands may use (default 1, if there is more than one)
+    void setReservedThreadCount(int count);
+    int reservedThreadCount() const;
+
+    //! Commands queued (not running) in the low and normal priority lanes
+    //! at most; 0, the default, doesn't limit them
+    void setMaximumQueueDepth(int commands);
+    int maximumQueueDepth() const;
+    void setOverflowPolicy(OverflowPolicy policy);
+    OverflowPolicy overflowPolicy() const;
+
+    //! Commands have NormalPriority unless changed here
+    void setCommandPriority(const QByteArray &commandName, Priority priority);
+    Priority commandPriority(const QByteArray &commandName) const;
+
+    //! Queues \arg job (taking ownership if it's auto-deleted). Returns false
+    //! if it has been rejected since the queue is full.
+    bool submit(QRunnable *job, Priority priority);
+    //! Whether the low and normal priority lanes hold maximumQueueDepth() commands
+    bool isQueueFull() const;
+    //! Tells \arg listener (taking ownership) once the queue isn't full,
+    //! right away if it isn't
+    void notifyWhenNotFull(RpcExecutorListener *listener);
+
+private:
+    Q_DISABLE_COPY(RpcExecutor)
+    friend class RpcExecutorTask;
+
+    QThreadPool pool;
+    mutable QMutex mutex;
+    QList<RpcExecutorListener *> listeners;
+    QQueue<QRunnable *> lanes[HighPriority + 1];
+    QHash<QByteArray, Priority> commandPriorities;
+    int reservedThreads;
+    int maxQueueDepth;
+    OverflowPolicy overflow;
+    int running;
+
+    int queueDepth() const;
+    //! Called with the mutex locked
+    void notifyListeners();
+    void scheduleJobs();
+    void jobFinished();
+};
+
+#endif // RPCEXECUTOR_H
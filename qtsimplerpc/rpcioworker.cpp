@@ -0,0 +1,156 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include "rpcioworker.h"
+#include "rpcconnection.h"
+
+#include <QTcpSocket>
+#include <QLocalSocket>
+#include <QMetaType>
+
+
+RpcIoWorker::RpcIoWorker(RpcCommandMapper *commandMapper, RpcExecutor *executor, QObject *parent) :
+    QObject(parent),
+    commandMapper(commandMapper),
+    executor(executor),
+    maxMessageSize(-1),
+    parallelDispatch(false),
+    threadAffineDispatch(false),
+    clients(0),
+    binaryFramingAccepted(false)
+{
+    // for queued hand-overs and signals across threads
+    qRegisterMetaType<quintptr>("quintptr");
+    qRegisterMetaType<quint32>("quint32");
+}
+
+int RpcIoWorker::load() const
+{
+    return clients;
+}
+
+void RpcIoWorker::setMaximumMessageSize(int bytes)
+{
+    maxMessageSize = bytes;
+}
+
+void RpcIoWorker::setParallelDispatchEnabled(bool enabled)
+{
+    parallelDispatch = enabled;
+}
+
+void RpcIoWorker::setThreadAffineDispatchEnabled(bool enabled)
+{
+    threadAffineDispatch = enabled;
+}
+
+void RpcIoWorker::setAcceptedFormats(bool binaryFraming, const QSet<QByteArray> &codecs, const QSet<QByteArray> &compressors)
+{
+    binaryFramingAccepted = binaryFraming;
+    acceptedCodecs = codecs;
+    acceptedCompressors = compressors;
+}
+
+void RpcIoWorker::assignTcpClient(int socketDescriptor, quint32 clientId)
+{
+    // counted right away, so a burst of clients gets spread over the workers
+    clients.ref();
+    QMetaObject::invokeMethod(this, "addTcpClient", Q_ARG(int, socketDescriptor), Q_ARG(quint32, clientId));
+}
+
+void RpcIoWorker::assignLocalClient(quintptr socketDescriptor, quint32 clientId)
+{
+    clients.ref();
+    QMetaObject::invokeMethod(this, "addLocalClient", Q_ARG(quintptr, socketDescriptor), Q_ARG(quint32, clientId));
+}
+
+void RpcIoWorker::closeClients()
+{
+    foreach(QObject *child, children())
+    {
+        child->disconnect(this);
+        delete child;
+    }
+    clientIds.clear();
+    clients = 0;
+}
+
+void RpcIoWorker::addTcpClient(int socketDescriptor, quint32 clientId)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    if(!socket->setSocketDescriptor(socketDescriptor)) {
+        qWarning("Can't set up accepted TCP client: %s", qPrintable(socket->errorString()));
+        delete socket;
+        clients.deref();
+        return;
+    }
+    addClient(socket, clientId);
+}
+
+void RpcIoWorker::addLocalClient(quintptr socketDescriptor, quint32 clientId)
+{
+    QLocalSocket *socket = new QLocalSocket(this);
+    if(!socket->setSocketDescriptor(socketDescriptor)) {
+        qWarning("Can't set up accepted local client: %s", qPrintable(socket->errorString()));
+        delete socket;
+        clients.deref();
+        return;
+    }
+    addClient(socket, clientId);
+}
+
+void RpcIoWorker::addClient(QIODevice *peerDevice, quint32 clientId)
+{
+    // the connection lives as long as its device, which is deleted on disconnect
+    RpcConnection *connection = new RpcConnection(peerDevice, commandMapper);
+    connection->setMaximumIdleReadBufferSize(0);
+    if(maxMessageSize >= 0)
+        connection->setMaximumMessageSize(maxMessageSize);
+    connection->setParallelDispatchEnabled(parallelDispatch);
+    connection->setThreadAffineDispatchEnabled(threadAffineDispatch);
+    connection->setExecutor(executor);
+    connection->setBinaryFramingAccepted(binaryFramingAccepted);
+    foreach(const QByteArray &codecName, acceptedCodecs)
+        connection->setCodecAccepted(codecName);
+    foreach(const QByteArray &compressorName, acceptedCompressors)
+        connection->setCompressionAccepted(compressorName);
+    connection->setPeerDevice(peerDevice);
+
+    connect(peerDevice, SIGNAL(disconnected()), SLOT(client_disconnected()));
+    // the device never leaves this thread, others only get to know the ID
+    clientIds.insert(peerDevice, clientId);
+    emit clientConnected(clientId);
+}
+
+void RpcIoWorker::client_disconnected()
+{
+    QIODevice *peerDevice = qobject_cast<QIODevice *>(sender());
+    if(!peerDevice)
+        return;
+
+    peerDevice->disconnect(this);
+    clients.deref();
+    emit clientDisconnected(clientIds.take(peerDevice));
+    peerDevice->deleteLater();
+}
@@ -0,0 +1,90 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#ifndef RPCIOWORKER_H
+#define RPCIOWORKER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QSet>
+#include <QHash>
+
+class QIODevice;
+class RpcCommandMapper;
+class RpcExecutor;
+
+//! Hosts the client connections of an RpcServer in the thread it lives in.
+//! The server hands accepted socket descriptors to the worker with the
+//! lowest load, the worker creates the socket and its RpcConnection in its
+//! own thread, so each thread parses, dispatches and encodes on its own.
+class RpcIoWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    RpcIoWorker(RpcCommandMapper *commandMapper, RpcExecutor *executor, QObject *parent = 0);
+
+    //! Number of clients hosted, including the ones handed over but not yet set up
+    int load() const;
+    void setMaximumMessageSize(int bytes);
+    void setParallelDispatchEnabled(bool enabled);
+    void setThreadAffineDispatchEnabled(bool enabled);
+    //! See RpcConnection::setBinaryFramingAccepted(), only set before clients are assigned
+    void setAcceptedFormats(bool binaryFraming, const QSet<QByteArray> &codecs, const QSet<QByteArray> &compressors);
+
+    //! Hands a client over to the worker's thread, \arg clientId is passed
+    //! by the signals about it
+    void assignTcpClient(int socketDescriptor, quint32 clientId);
+    void assignLocalClient(quintptr socketDescriptor, quint32 clientId);
+
+public slots:
+    //! Disconnects and deletes all clients, without emitting clientDisconnected()
+    void closeClients();
+
+signals:
+    void clientConnected(quint32 clientId);
+    void clientDisconnected(quint32 clientId);
+
+private slots:
+    void addTcpClient(int socketDescriptor, quint32 clientId);
+    void addLocalClient(quintptr socketDescriptor, quint32 clientId);
+    void client_disconnected();
+
+private:
+    RpcCommandMapper *commandMapper;
+    RpcExecutor *executor;
+    QAtomicInt maxMessageSize;
+    QAtomicInt parallelDispatch;
+    QAtomicInt threadAffineDispatch;
+    QAtomicInt clients;
+    bool binaryFramingAccepted;
+    QSet<QByteArray> acceptedCodecs;
+    QSet<QByteArray> acceptedCompressors;
+    //! Only used in the worker's thread
+    QHash<QIODevice *, quint32> clientIds;
+
+    void addClient(QIODevice *peerDevice, quint32 clientId);
+};
+
+#endif // RPCIOWORKER_H
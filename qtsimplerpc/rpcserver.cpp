@@ -0,0 +1,323 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include "rpcserver.h"
+#include "rpcioworker.h"
+#include "rpccommandmapper.h"
+#include "rpcexecutor.h"
+#include "rpccodec.h"
+#include "rpccompressor.h"
+
+#include <QTcpServer>
+#include <QLocalServer>
+#include <QThread>
+
+
+//! Hands accepted descriptors to the RpcServer instead of creating sockets
+class RpcTcpServer : public QTcpServer
+{
+public:
+    RpcTcpServer(RpcServer *server) : QTcpServer(server), server(server) {}
+
+protected:
+    void incomingConnection(int socketDescriptor)
+    {
+        server->leastLoadedWorker()->assignTcpClient(socketDescriptor, ++server->nextClientId);
+    }
+
+private:
+    RpcServer *server;
+};
+
+class RpcLocalServer : public QLocalServer
+{
+public:
+    RpcLocalServer(RpcServer *server) : QLocalServer(server), server(server) {}
+
+protected:
+    void incomingConnection(quintptr socketDescriptor)
+    {
+        server->leastLoadedWorker()->assignLocalClient(socketDescriptor, ++server->nextClientId);
+    }
+
+private:
+    RpcServer *server;
+};
+
+
+RpcServer::RpcServer(QObject *parent) :
+    QObject(parent),
+    commandMapper(new RpcCommandMapper(this)),
+    commandExecutor(new RpcExecutor),
+    tcpServer(0),
+    localServer(0),
+    maxMessageSize(-1),
+    parallelDispatch(false),
+    threadAffineDispatch(false),
+    binaryFramingAccepted(false),
+    threadCount(-1),
+    nextClientId(0)
+{
+}
+
+RpcServer::~RpcServer()
+{
+    close();
+    stopWorkers();
+    delete commandExecutor;
+}
+
+void RpcServer::setIoThreadCount(int count)
+{
+    if(!workers.isEmpty()) {
+        qWarning("Can't change the I/O thread count of a running server! Ignoring.");
+        return;
+    }
+    threadCount = count;
+}
+
+int RpcServer::ioThreadCount() const
+{
+    return (threadCount < 0) ? QThread::idealThreadCount() : threadCount;
+}
+
+bool RpcServer::listen(const QHostAddress &address, quint16 port)
+{
+    startWorkers();
+    if(!tcpServer)
+        tcpServer = new RpcTcpServer(this);
+    if(tcpServer->listen(address, port))
+        return true;
+    lastError = tcpServer->errorString();
+    return false;
+}
+
+bool RpcServer::listen(const QString &localServerName)
+{
+    startWorkers();
+    if(!localServer)
+        localServer = new RpcLocalServer(this);
+    if(localServer->listen(localServerName))
+        return true;
+    lastError = localServer->errorString();
+    return false;
+}
+
+void RpcServer::close()
+{
+    // accepted clients stay connected
+    if(tcpServer)
+        tcpServer->close();
+    if(localServer)
+        localServer->close();
+}
+
+bool RpcServer::isListening() const
+{
+    return (tcpServer && tcpServer->isListening()) || (localServer && localServer->isListening());
+}
+
+QString RpcServer::errorString() const
+{
+    return lastError;
+}
+
+void RpcServer::setMaximumMessageSize(int bytes)
+{
+    maxMessageSize = bytes;
+    foreach(RpcIoWorker *worker, workers)
+        worker->setMaximumMessageSize(bytes);
+}
+
+void RpcServer::setParallelDispatchEnabled(bool enabled)
+{
+    parallelDispatch = enabled;
+    foreach(RpcIoWorker *worker, workers)
+        worker->setParallelDispatchEnabled(enabled);
+}
+
+void RpcServer::setThreadAffineDispatchEnabled(bool enabled)
+{
+    threadAffineDispatch = enabled;
+    foreach(RpcIoWorker *worker, workers)
+        worker->setThreadAffineDispatchEnabled(enabled);
+}
+
+void RpcServer::setBinaryFramingAccepted(bool accepted)
+{
+    if(checkStopped())
+        binaryFramingAccepted = accepted;
+}
+
+void RpcServer::setCodecAccepted(const QByteArray &codecName, bool accepted)
+{
+    if(!checkStopped())
+        return;
+    if(accepted)
+        acceptedCodecs.insert(codecName);
+    else
+        acceptedCodecs.remove(codecName);
+}
+
+void RpcServer::setCompressionAccepted(const QByteArray &compressorName, bool accepted)
+{
+    if(!checkStopped())
+        return;
+    if(accepted)
+        acceptedCompressors.insert(compressorName);
+    else
+        acceptedCompressors.remove(compressorName);
+}
+
+RpcExecutor *RpcServer::executor() const
+{
+    return commandExecutor;
+}
+
+int RpcServer::connectionCount() const
+{
+    int count = 0;
+    foreach(RpcIoWorker *worker, workers)
+        count += worker->load();
+    return count;
+}
+
+void RpcServer::bindObjectAllSlotsIncoming(QObject *object)
+{
+    if(checkRegistryWritable())
+        commandMapper->addAllMappings(object);
+}
+
+void RpcServer::bindSlotAsCustomIncomingCommand(QObject *object, const char *member, QByteArray commandName, bool cacheable)
+{
+    if(!checkRegistryWritable())
+        return;
+    commandMapper->addMapping(commandName, object, member);
+    if(cacheable)
+        commandMapper->setCommandResponseCacheable(commandName, true);
+}
+
+void RpcServer::setCommandOrdered(QByteArray commandName, bool ordered)
+{
+    if(checkRegistryWritable())
+        commandMapper->setCommandOrdered(commandName, ordered);
+}
+
+void RpcServer::setCommandResponseCacheable(QByteArray commandName, bool cacheable)
+{
+    if(checkRegistryWritable())
+        commandMapper->setCommandResponseCacheable(commandName, cacheable);
+}
+
+void RpcServer::setResponseCacheSize(int bytes)
+{
+    // the cache is locked on its own, so this may change while running
+    commandMapper->setResponseCacheSize(bytes);
+}
+
+bool RpcServer::checkRegistryWritable()
+{
+    if(!workers.isEmpty()) {
+        qWarning("Can't bind objects while the server is running! Ignoring.");
+        return false;
+    }
+    return true;
+}
+
+bool RpcServer::checkStopped()
+{
+    if(!workers.isEmpty()) {
+        qWarning("Can't change accepted formats while the server is running! Ignoring.");
+        return false;
+    }
+    return true;
+}
+
+void RpcServer::startWorkers()
+{
+    if(!workers.isEmpty())
+        return;
+
+    int count = ioThreadCount();
+    if(count <= 0)
+    {
+        workers << new RpcIoWorker(commandMapper, commandExecutor);
+    }
+    else
+    {
+        // built-in codecs and compressors are created on first use, do it before any thread can
+        RpcCodec::defaultCodec();
+        RpcCompressor::compressor("zlib");
+
+        for(int i = 0; i < count; ++i)
+        {
+            QThread *thread = new QThread;
+            RpcIoWorker *worker = new RpcIoWorker(commandMapper, commandExecutor);
+            worker->moveToThread(thread);
+            thread->start();
+            ioThreads << thread;
+            workers << worker;
+        }
+    }
+
+    foreach(RpcIoWorker *worker, workers)
+    {
+        worker->setMaximumMessageSize(maxMessageSize);
+        worker->setParallelDispatchEnabled(parallelDispatch);
+        worker->setThreadAffineDispatchEnabled(threadAffineDispatch);
+        worker->setAcceptedFormats(binaryFramingAccepted, acceptedCodecs, acceptedCompressors);
+        connect(worker, SIGNAL(clientConnected(quint32)), SIGNAL(clientConnected(quint32)));
+        connect(worker, SIGNAL(clientDisconnected(quint32)), SIGNAL(clientDisconnected(quint32)));
+    }
+}
+
+void RpcServer::stopWorkers()
+{
+    // clients have to be deleted in their own thread, then the thread can go
+    foreach(RpcIoWorker *worker, workers)
+    {
+        if(ioThreads.isEmpty())
+            worker->closeClients();
+        else
+            QMetaObject::invokeMethod(worker, "closeClients", Qt::BlockingQueuedConnection);
+    }
+    foreach(QThread *thread, ioThreads)
+    {
+        thread->quit();
+        thread->wait();
+    }
+    qDeleteAll(workers);
+    qDeleteAll(ioThreads);
+    workers.clear();
+    ioThreads.clear();
+}
+
+RpcIoWorker *RpcServer::leastLoadedWorker() const
+{
+    RpcIoWorker *leastLoaded = workers.first();
+    foreach(RpcIoWorker *worker, workers)
+        if(worker->load() < leastLoaded->load())
+            leastLoaded = worker;
+    return leastLoaded;
+}
@@ -0,0 +1,126 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#ifndef RPCSERVER_H
+#define RPCSERVER_H
+
+#include <qtsimplerpc_global.h>
+
+#include <QObject>
+#include <QHostAddress>
+#include <QSet>
+
+class QThread;
+class RpcCommandMapper;
+class RpcIoWorker;
+class RpcExecutor;
+class RpcTcpServer;
+class RpcLocalServer;
+
+//! Accepts any number of clients on a TCP port and/or a local socket. All
+//! clients share one command registry: objects are bound once, before the
+//! server starts listening, and each accepted client only gets lightweight
+//! connection state. The registry can't be changed while listening.
+class QTSIMPLERPC_EXPORT RpcServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RpcServer(QObject *parent = 0);
+    ~RpcServer();
+
+    //! Serves clients in \arg count threads with an event loop each (-1, the
+    //! default, for one per core) or in the server's thread (0). New clients
+    //! go to the thread serving the fewest. Bound objects are called from
+    //! these threads and must be thread-safe unless the count is 0 or thread
+    //! affine dispatch is enabled. Set this before listening.
+    void setIoThreadCount(int count);
+    int ioThreadCount() const;
+
+    bool listen(const QHostAddress &address, quint16 port = 0);
+    bool listen(const QString &localServerName);
+    void close();
+    bool isListening() const;
+    QString errorString() const;
+
+    //! Applies to connections accepted from now on, see QtSimpleRpc::setMaximumMessageSize()
+    void setMaximumMessageSize(int bytes);
+    //! Applies to connections accepted from now on, see RpcConnection::setParallelDispatchEnabled()
+    void setParallelDispatchEnabled(bool enabled);
+    //! Applies to connections accepted from now on, see RpcConnection::setThreadAffineDispatchEnabled()
+    void setThreadAffineDispatchEnabled(bool enabled);
+    //! Lets clients switch to binary framing, or the named codec or
+    //! compressor, see RpcConnection::setBinaryFramingAccepted(). Nothing is
+    //! accepted by default. Set this before listening.
+    void setBinaryFramingAccepted(bool accepted);
+    void setCodecAccepted(const QByteArray &codecName, bool accepted = true);
+    void setCompressionAccepted(const QByteArray &compressorName, bool accepted = true);
+    //! Runs the parallel and asynchronous commands of all clients, configure it before listening
+    RpcExecutor *executor() const;
+    int connectionCount() const;
+
+public slots:
+    void bindObjectAllSlotsIncoming(QObject *object);
+    //! The encoded responses of \arg cacheable commands are reused for the same arguments
+    void bindSlotAsCustomIncomingCommand(QObject *object, const char *member, QByteArray commandName, bool cacheable = false);
+    //! See RpcCommandMapper::setCommandOrdered()
+    void setCommandOrdered(QByteArray commandName, bool ordered = true);
+    //! Same as RpcConnection::setCommandResponseCacheable()
+    void setCommandResponseCacheable(QByteArray commandName, bool cacheable = true);
+    void setResponseCacheSize(int bytes);
+
+signals:
+    //! \arg clientId identifies the client among all clients of this server
+    //! (clients live in their I/O thread, so their devices aren't passed)
+    void clientConnected(quint32 clientId);
+    void clientDisconnected(quint32 clientId);
+
+private:
+    friend class RpcTcpServer;
+    friend class RpcLocalServer;
+
+    RpcCommandMapper *commandMapper;
+    RpcExecutor *commandExecutor;
+    RpcTcpServer *tcpServer;
+    RpcLocalServer *localServer;
+    int maxMessageSize;
+    bool parallelDispatch;
+    bool threadAffineDispatch;
+    bool binaryFramingAccepted;
+    QSet<QByteArray> acceptedCodecs;
+    QSet<QByteArray> acceptedCompressors;
+    int threadCount;
+    quint32 nextClientId;
+    QList<QThread *> ioThreads;
+    QList<RpcIoWorker *> workers;
+    QString lastError;
+
+    bool checkRegistryWritable();
+    bool checkStopped();
+    void startWorkers();
+    void stopWorkers();
+    RpcIoWorker *leastLoadedWorker() const;
+};
+
+#endif // RPCSERVER_H
@@ -0,0 +1,121 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+
+#include "rpcsharedbuffer.h"
+
+#include <QSharedMemory>
+#include <QUuid>
+
+// only segments created by RpcSharedBuffer can be referred to by peers
+#define KEY_PREFIX "QtSimpleRpc-buffer-"
+
+
+RpcSharedBuffer::RpcSharedBuffer() :
+    bufferSize(0)
+{
+}
+
+RpcSharedBuffer RpcSharedBuffer::create(int size)
+{
+    RpcSharedBuffer buffer;
+    if(size <= 0)
+        return buffer;
+
+    QSharedPointer<QSharedMemory> segment(new QSharedMemory(KEY_PREFIX + QUuid::createUuid().toString()));
+    if(!segment->create(size)) {
+        qWarning("Can't create shared buffer: %s", qPrintable(segment->errorString()));
+        return buffer;
+    }
+    buffer.segment = segment;
+    buffer.bufferSize = size;
+    return buffer;
+}
+
+RpcSharedBuffer RpcSharedBuffer::fromReference(const QVariant &reference)
+{
+    RpcSharedBuffer buffer;
+    if(!isReference(reference))
+        return buffer;
+
+    QVariantMap map = reference.toMap();
+    QSharedPointer<QSharedMemory> segment(new QSharedMemory(map.value("sharedBuffer").toString()));
+    if(!segment->attach()) {
+        qWarning("Can't attach to shared buffer: %s", qPrintable(segment->errorString()));
+        return buffer;
+    }
+    // the segment may be rounded up to whole pages, but never be smaller
+    int size = map.value("size").toInt();
+    if(size <= 0 || size > segment->size()) {
+        qWarning("Received invalid shared buffer size! Ignoring.");
+        return buffer;
+    }
+    buffer.segment = segment;
+    buffer.bufferSize = size;
+    return buffer;
+}
+
+bool RpcSharedBuffer::isReference(const QVariant &value)
+{
+    if(value.type() != QVariant::Map)
+        return false;
+    QVariantMap map = value.toMap();
+    return map.size() == 2 && map.contains("size") &&
+            map.value("sharedBuffer").toString().startsWith(KEY_PREFIX);
+}
+
+bool RpcSharedBuffer::isValid() const
+{
+    return !segment.isNull();
+}
+
+int RpcSharedBuffer::size() const
+{
+    return bufferSize;
+}
+
+char *RpcSharedBuffer::data()
+{
+    return segment ? reinterpret_cast<char *>(segment->data()) : 0;
+}
+
+const char *RpcSharedBuffer::constData() const
+{
+    return segment ? reinterpret_cast<const char *>(segment->constData()) : 0;
+}
+
+QString RpcSharedBuffer::key() const
+{
+    return segment ? segment->key() : QString();
+}
+
+QVariant RpcSharedBuffer::reference() const
+{
+    if(!segment)
+        return QVariant();
+    QVariantMap map;
+    map.insert("sharedBuffer", segment->key());
+    map.insert("size", bufferSize);
+    return map;
+}
@@ -0,0 +1,71 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+
+#ifndef RPCSHAREDBUFFER_H
+#define RPCSHAREDBUFFER_H
+
+#include <qtsimplerpc_global.h>
+
+#include <QVariant>
+#include <QSharedPointer>
+#include <QMetaType>
+
+class QSharedMemory;
+
+//! A block of shared memory for passing large arguments to peers on the
+//! same host without copying them through the connection. The caller
+//! creates a buffer, fills data() and passes reference() as the argument;
+//! only the key and size are sent. A slot taking an RpcSharedBuffer
+//! parameter gets a buffer attached to the same memory. The caller has to
+//! keep its buffer until the call has finished, as the memory is freed
+//! once the last buffer attached to it is gone.
+class QTSIMPLERPC_EXPORT RpcSharedBuffer
+{
+public:
+    //! Creates a null buffer
+    RpcSharedBuffer();
+    //! Creates a new segment of \arg size bytes; check isValid()
+    static RpcSharedBuffer create(int size);
+    //! Attaches to the buffer \arg reference refers to
+    static RpcSharedBuffer fromReference(const QVariant &reference);
+    static bool isReference(const QVariant &value);
+
+    bool isValid() const;
+    int size() const;
+    char *data();
+    const char *constData() const;
+    QString key() const;
+
+    //! The argument to pass instead of the buffer
+    QVariant reference() const;
+
+private:
+    QSharedPointer<QSharedMemory> segment;
+    int bufferSize;
+};
+
+Q_DECLARE_METATYPE(RpcSharedBuffer)
+
+#endif // RPCSHAREDBUFFER_H
@@ -0,0 +1,318 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include "rpcsharedmemorydevice.h"
+
+#include <QLocalSocket>
+#include <QUuid>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <string.h>
+
+/*
+  Segment layout: quint32 ring size, then the ring written by the creator,
+  then the ring written by the attaching peer. Each ring has a single writer
+  and a single reader, which only ever advance their own counter. Counters
+  count bytes since the start and wrap around, so the ring holds
+  (writeCount - readCount) bytes. The ring size is a power of two, so
+  (counter % ring size) stays continuous when a counter wraps around.
+
+  The doorbell is only rung when the peer asked for it: a reader which
+  has drained its ring sets readerWaiting, a writer which found the ring
+  full sets writerWaiting. Each side sets its flag before checking the
+  counters again and the other side clears it after updating its counter,
+  so a wakeup is never lost while busy peers exchange no doorbell bytes.
+*/
+
+struct RpcSharedRing
+{
+    QAtomicInt writeCount;
+    QAtomicInt readCount;
+    QAtomicInt readerWaiting;
+    QAtomicInt writerWaiting;
+
+    char *data() { return reinterpret_cast<char *>(this + 1); }
+
+    // ordered reads and writes of the counters, as the peer runs concurrently
+    quint32 written() { return quint32(writeCount.fetchAndAddOrdered(0)); }
+    quint32 read() { return quint32(readCount.fetchAndAddOrdered(0)); }
+};
+
+#define SEGMENT_HEADER_SIZE 8
+#define MAX_RING_SIZE (1 << 30)
+
+
+RpcSharedMemoryDevice::RpcSharedMemoryDevice(QObject *parent) :
+    QIODevice(parent),
+    doorbell(0),
+    ringSize(0),
+    inRing(0),
+    outRing(0)
+{
+}
+
+RpcSharedMemoryDevice::~RpcSharedMemoryDevice()
+{
+    close();
+}
+
+bool RpcSharedMemoryDevice::create(QLocalSocket *doorbellSocket, int ringSize)
+{
+    int size = 1;
+    while(size < ringSize && size < MAX_RING_SIZE)
+        size <<= 1;
+    ringSize = size;
+
+    segment.setKey("QtSimpleRpc-" + QUuid::createUuid().toString());
+    int ringBytes = sizeof(RpcSharedRing) + ringSize;
+    if(!segment.create(SEGMENT_HEADER_SIZE + 2 * ringBytes)) {
+        setErrorString(segment.errorString());
+        return false;
+    }
+    memset(segment.data(), 0, segment.size());
+    *reinterpret_cast<quint32 *>(segment.data()) = ringSize;
+    // neither reader has seen data yet, so the first write rings the doorbell
+    char *firstRing = reinterpret_cast<char *>(segment.data()) + SEGMENT_HEADER_SIZE;
+    reinterpret_cast<RpcSharedRing *>(firstRing)->readerWaiting.fetchAndStoreOrdered(1);
+    reinterpret_cast<RpcSharedRing *>(firstRing + ringBytes)->readerWaiting.fetchAndStoreOrdered(1);
+
+    doorbell = doorbellSocket;
+    connect(doorbell, SIGNAL(readyRead()), SLOT(doorbell_readyRead()));
+    connect(doorbell, SIGNAL(disconnected()), SLOT(doorbell_disconnected()));
+    doorbell->write("shm " + segment.key().toUtf8() + "\n");
+
+    setupRings(true);
+    return true;
+}
+
+void RpcSharedMemoryDevice::attach(QLocalSocket *doorbellSocket)
+{
+    doorbell = doorbellSocket;
+    connect(doorbell, SIGNAL(readyRead()), SLOT(doorbell_readyRead()));
+    connect(doorbell, SIGNAL(disconnected()), SLOT(doorbell_disconnected()));
+    // writes are kept until the rings are set up
+    QIODevice::open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+    doorbell_readyRead(); // the key may be there already
+}
+
+bool RpcSharedMemoryDevice::isAttached() const
+{
+    return inRing != 0;
+}
+
+void RpcSharedMemoryDevice::setupRings(bool creator)
+{
+    ringSize = *reinterpret_cast<quint32 *>(segment.data());
+    char *firstRing = reinterpret_cast<char *>(segment.data()) + SEGMENT_HEADER_SIZE;
+    char *secondRing = firstRing + sizeof(RpcSharedRing) + ringSize;
+    outRing = reinterpret_cast<RpcSharedRing *>(creator ? firstRing : secondRing);
+    inRing = reinterpret_cast<RpcSharedRing *>(creator ? secondRing : firstRing);
+
+    if(!isOpen())
+        QIODevice::open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+    emit attached();
+    flushPendingWrite();
+}
+
+bool RpcSharedMemoryDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 RpcSharedMemoryDevice::bytesAvailable() const
+{
+    qint64 available = inRing ? qint64(inRing->written() - inRing->read()) : 0;
+    return available + QIODevice::bytesAvailable();
+}
+
+qint64 RpcSharedMemoryDevice::bytesToWrite() const
+{
+    return pendingWrite.size();
+}
+
+void RpcSharedMemoryDevice::close()
+{
+    if(!isOpen() && !doorbell)
+        return;
+
+    QIODevice::close();
+    if(doorbell) {
+        doorbell->disconnect(this);
+        doorbell = 0;
+    }
+    inRing = outRing = 0;
+    pendingWrite.clear();
+    segment.detach();
+}
+
+qint64 RpcSharedMemoryDevice::readData(char *data, qint64 maxSize)
+{
+    if(!inRing)
+        return 0;
+
+    quint32 readCount = inRing->read();
+    quint32 used = inRing->written() - readCount;
+    quint32 size = quint32(qMin<qint64>(maxSize, used));
+    if(size)
+    {
+        // copy in up to two parts if the data wraps around the end of the ring
+        quint32 start = readCount % ringSize;
+        quint32 firstPart = qMin(size, ringSize - start);
+        memcpy(data, inRing->data() + start, firstPart);
+        memcpy(data + firstPart, inRing->data(), size - firstPart);
+        readCount += size;
+        inRing->readCount.fetchAndStoreOrdered(int(readCount));
+
+        // the peer found the ring full, tell it about the free space
+        if(inRing->writerWaiting.testAndSetOrdered(1, 0))
+            ringDoorbell();
+    }
+
+    if(size == used)
+    {
+        // drained: ask the peer to ring when it writes again, unless it
+        // has written before it could see the flag
+        inRing->readerWaiting.fetchAndStoreOrdered(1);
+        if(inRing->written() != readCount && inRing->readerWaiting.testAndSetOrdered(1, 0))
+            QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection);
+    }
+    return size;
+}
+
+qint64 RpcSharedMemoryDevice::writeData(const char *data, qint64 maxSize)
+{
+    // keep the order: nothing goes into the ring while older data is pending
+    pendingWrite.append(data, int(maxSize));
+    flushPendingWrite();
+    return maxSize;
+}
+
+qint64 RpcSharedMemoryDevice::flushPendingWrite()
+{
+    if(!outRing || pendingWrite.isEmpty())
+        return 0;
+
+    quint32 writeCount = outRing->written();
+    quint32 flushed = 0;
+    bool waiting = false;
+    forever
+    {
+        quint32 space = ringSize - (writeCount + flushed - outRing->read());
+        quint32 size = qMin(space, quint32(pendingWrite.size()) - flushed);
+        if(size)
+        {
+            quint32 start = (writeCount + flushed) % ringSize;
+            quint32 firstPart = qMin(size, ringSize - start);
+            const char *source = pendingWrite.constData() + flushed;
+            memcpy(outRing->data() + start, source, firstPart);
+            memcpy(outRing->data(), source + firstPart, size - firstPart);
+            flushed += size;
+        }
+        if(flushed == quint32(pendingWrite.size()) || waiting)
+            break;
+
+        // the ring is full: ask the peer to ring once it has freed space and
+        // check again, as it may have done so before seeing the flag
+        outRing->writerWaiting.fetchAndStoreOrdered(1);
+        waiting = true;
+    }
+    if(!flushed)
+        return 0;
+
+    outRing->writeCount.fetchAndStoreOrdered(int(writeCount + flushed));
+    // a busy reader comes back to the ring by itself
+    if(outRing->readerWaiting.testAndSetOrdered(1, 0))
+        ringDoorbell();
+
+    pendingWrite.remove(0, flushed);
+    emit bytesWritten(flushed);
+    return flushed;
+}
+
+bool RpcSharedMemoryDevice::waitForBytesWritten(int msecs)
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    while(doorbell && !pendingWrite.isEmpty())
+    {
+        // the peer frees space after reading and tells us through the doorbell
+        doorbell->flush();
+        int remaining = (msecs < 0) ? -1 : int(msecs - elapsed.elapsed());
+        if((msecs >= 0 && remaining <= 0) || !doorbell->waitForReadyRead(remaining))
+            return false;
+
+        int pending = pendingWrite.size();
+        doorbell_readyRead();
+        if(pendingWrite.size() < pending)
+            return true;
+    }
+    return false;
+}
+
+void RpcSharedMemoryDevice::ringDoorbell()
+{
+    if(doorbell)
+        doorbell->write(".", 1);
+}
+
+void RpcSharedMemoryDevice::doorbell_readyRead()
+{
+    if(!doorbell)
+        return;
+
+    QByteArray bytes = doorbell->readAll();
+    if(!inRing)
+    {
+        // waiting for the key of the creator's segment
+        handshake += bytes;
+        int end = handshake.indexOf('\n');
+        if(end == -1)
+            return;
+        if(!handshake.startsWith("shm ")) {
+            qWarning("Received invalid shared memory handshake! Ignoring.");
+            handshake.clear();
+            return;
+        }
+        segment.setKey(QString::fromUtf8(handshake.mid(4, end - 4)));
+        handshake.clear();
+        if(!segment.attach()) {
+            setErrorString(segment.errorString());
+            qWarning("Can't attach to shared memory segment: %s", qPrintable(segment.errorString()));
+            return;
+        }
+        setupRings(false);
+    }
+
+    // any byte means the peer has written data or freed space
+    flushPendingWrite();
+    if(inRing->written() != inRing->read())
+        emit readyRead();
+}
+
+void RpcSharedMemoryDevice::doorbell_disconnected()
+{
+    close();
+    emit disconnected();
+}
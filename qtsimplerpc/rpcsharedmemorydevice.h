@@ -0,0 +1,102 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#ifndef RPCSHAREDMEMORYDEVICE_H
+#define RPCSHAREDMEMORYDEVICE_H
+
+#include <qtsimplerpc_global.h>
+
+#include <QIODevice>
+#include <QSharedMemory>
+
+class QLocalSocket;
+struct RpcSharedRing;
+
+//! A device for peers on the same host, to be used with setPeerDevice().
+//! Data is passed through two ring buffers (one per direction) in a shared
+//! memory segment, without going through the kernel. A connected local
+//! socket is only used as a doorbell: a byte is sent to wake up the peer
+//! only while it waits for data or for free space.
+//!
+//! One peer calls create() with its end of the local socket, which creates
+//! the segment and tells the peer its key; the other peer calls attach()
+//! with its end and is ready once the key has arrived. Data written before
+//! is kept until then.
+//!
+//! Frames still are copied into the ring; use RpcSharedBuffer to pass
+//! large arguments by reference instead.
+class QTSIMPLERPC_EXPORT RpcSharedMemoryDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    explicit RpcSharedMemoryDevice(QObject *parent = 0);
+    ~RpcSharedMemoryDevice();
+
+    //! Creates a segment with two rings of \arg ringSize bytes each (rounded
+    //! up to a power of two, at most 1 GiB) and sends its key through \arg
+    //! doorbellSocket, which isn't taken ownership of
+    bool create(QLocalSocket *doorbellSocket, int ringSize = 1024 * 1024);
+    //! Attaches to the segment of the peer as soon as its key arrives
+    void attach(QLocalSocket *doorbellSocket);
+    bool isAttached() const;
+
+    bool isSequential() const;
+    qint64 bytesAvailable() const;
+    qint64 bytesToWrite() const;
+    //! Waits until the peer has freed space for data not written into the
+    //! ring yet, or the key has arrived if not attached yet
+    bool waitForBytesWritten(int msecs);
+    void close();
+
+signals:
+    void attached();
+    //! The doorbell socket has been disconnected, the device is closed
+    void disconnected();
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private slots:
+    void doorbell_readyRead();
+    void doorbell_disconnected();
+
+private:
+    QLocalSocket *doorbell;
+    QSharedMemory segment;
+    QByteArray handshake;
+    quint32 ringSize;
+    RpcSharedRing *inRing;
+    RpcSharedRing *outRing;
+    //! Data not fitting into the outgoing ring yet
+    QByteArray pendingWrite;
+
+    void setupRings(bool creator);
+    void ringDoorbell();
+    //! Moves pending data into the outgoing ring
+    qint64 flushPendingWrite();
+};
+
+#endif // RPCSHAREDMEMORYDEVICE_H
@@ -23,13 +23,14 @@
 
 #include "rpcsignalmapper.h"
 #include "rpcsignalmapperhelper.h"
+#include <QTimerEvent>
 
 RpcSignalMapper::RpcSignalMapper(QObject *parent) :
     QObject(parent)
 {
 }
 
-void RpcSignalMapper::addMapping(QObject *object, const char *signal, const QByteArray &commandName, bool async)
+bool RpcSignalMapper::findSignal(QObject *object, const char *signal, QMetaMethod *method) const
 {
     // remove leading digit of SIGNAL() macro
     QByteArray signalSignature = (signal[0] == '2')
@@ -37,21 +38,28 @@ void RpcSignalMapper::addMapping(QObject *object, const char *signal, const QByt
             : QByteArray(signal);
 
     const QMetaObject *mo = object->metaObject();
-    QMetaMethod method;
 
     for(int i = QObject::staticMetaObject.methodCount(); i < mo->methodCount(); ++i)
         if(signalSignature == mo->method(i).signature())
-            method = mo->method(i);
+            *method = mo->method(i);
 
-    if(!method.enclosingMetaObject())
+    if(!method->enclosingMetaObject()) {
         qWarning("Can't map signal \"%s\": signal not found in class %s.",
                  signalSignature.constData(), mo->className());
-    else
+        return false;
+    }
+    return true;
+}
+
+void RpcSignalMapper::addMapping(QObject *object, const char *signal, const QByteArray &commandName, bool async)
+{
+    QMetaMethod method;
+    if(findSignal(object, signal, &method))
     {
         RpcSignalMapperHelper *helper = new RpcSignalMapperHelper(method, this);
 
         // connect object to helper
-        connect(object, QByteArray("2") + signalSignature,
+        connect(object, QByteArray("2") + method.signature(),
                 helper, SLOT(map()));
         // connect helper to my handler
         connect(helper, SIGNAL(mapped(QObject*,QMetaMethod,QVariantList)),
@@ -64,6 +72,11 @@ void RpcSignalMapper::addMapping(QObject *object, const char *signal, const QByt
         MappedCommand command;
         command.commandName = commandName;
         command.async = async;
+        command.helper = helper;
+        command.window = 0;
+        command.minimumInterval = 0;
+        command.keyArgument = -1;
+        command.timerId = 0;
 
         mappings.insert(objectSignal, command);
     }
@@ -75,15 +88,115 @@ void RpcSignalMapper::signalHandler(QObject *sender, QMetaMethod signal, QVarian
     objectSignal.obj = sender;
     objectSignal.signalIndex = signal.methodIndex();
 
-    if(mappings.contains(objectSignal))
+    QMap<ObjectSignal, MappedCommand>::iterator i = mappings.find(objectSignal);
+    if(i == mappings.end()) {
+        qWarning("Received signal but couldn't find correct mapping!");
+        return;
+    }
+    MappedCommand &command = i.value();
+    if(!command.window && !command.minimumInterval) {
+        forward(command, arguments);
+        return;
+    }
+
+    // hold the latest arguments (per key) until they are due
+    QString key = (command.keyArgument >= 0) ? arguments.value(command.keyArgument).toString() : QString();
+    if(!command.held.contains(key))
+        command.heldKeys << key;
+    command.held.insert(key, arguments);
+    if(command.timerId)
+        return;
+
+    qint64 delay = command.window;
+    if(command.minimumInterval && command.lastForwarded.isValid())
+        delay = qMax(delay, command.minimumInterval - command.lastForwarded.elapsed());
+    if(delay <= 0) {
+        forwardHeld(command);
+        return;
+    }
+    command.timerId = startTimer(int(delay));
+    timers.insert(command.timerId, objectSignal);
+}
+
+void RpcSignalMapper::setConflationWindow(QObject *object, const char *signal, int window, int keyArgument)
+{
+    MappedCommand *command = findMapping(object, signal);
+    if(command) {
+        command->window = qMax(window, 0);
+        command->keyArgument = keyArgument;
+    }
+}
+
+void RpcSignalMapper::setMinimumInterval(QObject *object, const char *signal, int interval, int keyArgument)
+{
+    MappedCommand *command = findMapping(object, signal);
+    if(command) {
+        command->minimumInterval = qMax(interval, 0);
+        command->keyArgument = keyArgument;
+    }
+}
+
+void RpcSignalMapper::setCommandEnabled(const QByteArray &commandName, bool enabled)
+{
+    QMap<ObjectSignal, MappedCommand>::iterator i;
+    for(i = mappings.begin(); i != mappings.end(); ++i)
     {
-        MappedCommand command = mappings.value(objectSignal);
+        if(i.value().commandName == commandName)
+            i.value().helper->setEnabled(enabled);
+    }
+}
+
+void RpcSignalMapper::setAllCommandsEnabled(bool enabled)
+{
+    foreach(MappedCommand command, mappings)
+        command.helper->setEnabled(enabled);
+}
+
+RpcSignalMapper::MappedCommand *RpcSignalMapper::findMapping(QObject *object, const char *signal)
+{
+    QMetaMethod method;
+    if(!findSignal(object, signal, &method))
+        return 0;
 
-        if(command.async)
-            emit mappedCommandAsync(command.commandName, arguments);
-        else
-            emit mappedCommand(command.commandName, arguments);
+    ObjectSignal objectSignal;
+    objectSignal.obj = object;
+    objectSignal.signalIndex = method.methodIndex();
+    QMap<ObjectSignal, MappedCommand>::iterator i = mappings.find(objectSignal);
+    if(i == mappings.end()) {
+        qWarning("Signal \"%s\" of class %s isn't mapped! Ignoring.",
+                 method.signature(), object->metaObject()->className());
+        return 0;
     }
+    return &i.value();
+}
+
+void RpcSignalMapper::timerEvent(QTimerEvent *event)
+{
+    killTimer(event->timerId());
+    ObjectSignal objectSignal = timers.take(event->timerId());
+    QMap<ObjectSignal, MappedCommand>::iterator i = mappings.find(objectSignal);
+    if(i == mappings.end())
+        return;
+    i.value().timerId = 0;
+    forwardHeld(i.value());
+}
+
+void RpcSignalMapper::forward(MappedCommand &command, const QVariantList &arguments)
+{
+    command.lastForwarded.start();
+    if(command.async)
+        emit mappedCommandAsync(command.commandName, arguments);
     else
-        qWarning("Received signal but couldn't find correct mapping!");
+        emit mappedCommand(command.commandName, arguments);
+}
+
+void RpcSignalMapper::forwardHeld(MappedCommand &command)
+{
+    // a synchronous forward may run an event loop and emit again, so take them first
+    QHash<QString, QVariantList> held = command.held;
+    QStringList heldKeys = command.heldKeys;
+    command.held.clear();
+    command.heldKeys.clear();
+    foreach(QString key, heldKeys)
+        forward(command, held.value(key));
 }
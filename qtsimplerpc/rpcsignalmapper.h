@@ -27,6 +27,12 @@
 #include <QObject>
 #include <QVariantList>
 #include <QMetaMethod>
+#include <QMap>
+#include <QHash>
+#include <QStringList>
+#include <QElapsedTimer>
+
+class RpcSignalMapperHelper;
 
 class RpcSignalMapper : public QObject
 {
@@ -42,6 +48,24 @@ signals:
 public:
     void addMapping(QObject *object, const char *signal, const QByteArray &commandName, bool async = true);
 
+    //! Emissions of a mapped signal are held for \arg window msec, then only
+    //! the latest arguments are forwarded ("latest value wins"). With a \arg
+    //! keyArgument (index of an argument, compared as string), the latest
+    //! emission per value of that argument is forwarded. Held emissions are
+    //! replaced, never queued. A window of 0 forwards every emission.
+    void setConflationWindow(QObject *object, const char *signal, int window, int keyArgument = -1);
+    //! Forwards emissions of a mapped signal at most every \arg interval msec,
+    //! the ones in between are conflated as above. 0 removes the limit.
+    void setMinimumInterval(QObject *object, const char *signal, int interval, int keyArgument = -1);
+
+    //! Signals mapped to a disabled command are ignored as soon as they are
+    //! emitted, without converting their arguments. Mappings are enabled by default.
+    void setCommandEnabled(const QByteArray &commandName, bool enabled);
+    void setAllCommandsEnabled(bool enabled);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
 private slots:
     void signalHandler(QObject *sender, QMetaMethod signal, QVariantList arguments);
 
@@ -56,8 +80,25 @@ private:
     struct MappedCommand {
         QByteArray commandName;
         bool async;
+        RpcSignalMapperHelper *helper;
+        //! Conflation policy, see setConflationWindow() and setMinimumInterval()
+        int window;
+        int minimumInterval;
+        int keyArgument;
+        //! Latest held arguments per key, in order of first emission
+        QHash<QString, QVariantList> held;
+        QStringList heldKeys;
+        //! Timer forwarding the held emissions, 0 if none are held
+        int timerId;
+        QElapsedTimer lastForwarded;
     };
     QMap<ObjectSignal, MappedCommand> mappings;
+    QHash<int, ObjectSignal> timers;
+
+    bool findSignal(QObject *object, const char *signal, QMetaMethod *method) const;
+    MappedCommand *findMapping(QObject *object, const char *signal);
+    void forward(MappedCommand &command, const QVariantList &arguments);
+    void forwardHeld(MappedCommand &command);
 };
 
 
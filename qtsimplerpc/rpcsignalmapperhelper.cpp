@@ -26,10 +26,21 @@
 
 RpcSignalMapperHelper::RpcSignalMapperHelper(QMetaMethod mappedMethod, QObject *parent) :
     QObject(parent),
-    method(mappedMethod)
+    method(mappedMethod),
+    enabled(true)
 {
 }
 
+void RpcSignalMapperHelper::setEnabled(bool enabled)
+{
+    this->enabled = enabled;
+}
+
+bool RpcSignalMapperHelper::isEnabled() const
+{
+    return enabled;
+}
+
 void RpcSignalMapperHelper::map()
 {
     qWarning("RpcSignalMapperHelper::map() has been called directly.");
@@ -37,6 +48,9 @@ void RpcSignalMapperHelper::map()
 
 void RpcSignalMapperHelper::internalSignalHandler(void **_a)
 {
+    if(!enabled)
+        return;
+
     QVariantList args;
     int i = 0;
     foreach(QByteArray typeName, method.parameterTypes())
@@ -43,6 +43,10 @@ class RpcSignalMapperHelper : public QObject
 public:
     explicit RpcSignalMapperHelper(QMetaMethod mappedMethod, QObject *parent = 0);
 
+    //! A disabled helper ignores the signal without converting its arguments
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
 signals:
     //! Mapped signal which gets emitted whenever the slot map() has been called.
     //! Note that it only gets emitted when map() has been called using Qt's
@@ -68,6 +72,7 @@ private:
     //! The signal which is connected to map(). This meta method is used
     //! to get the type info of the parameters of the meta call.
     QMetaMethod method;
+    bool enabled;
 };
 
 #endif // GENERICSIGNALMAPPER_H
@@ -0,0 +1,232 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include "rpcstreamwriter.h"
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <limits.h>
+
+
+class RpcStreamWriterData
+{
+public:
+    mutable QMutex mutex;
+    QWaitCondition writable;
+    QQueue<QVariant> chunks;
+    int credits;
+    bool ended;
+    bool successful;
+    QVariant result;
+    bool canceled;
+    //! Whether the target has been told about chunks it hasn't taken yet
+    bool notified;
+    RpcStreamTarget *target;
+
+    RpcStreamWriterData() : credits(0), ended(false), successful(false), canceled(false), notified(false), target(0) {}
+
+    ~RpcStreamWriterData()
+    {
+        delete target;
+    }
+
+    bool isWritable() const
+    {
+        // one chunk may wait for credit, so the writer can run ahead a little
+        return canceled || chunks.count() < qMax(credits, 1);
+    }
+
+    //! Called with the mutex locked
+    void notifyTarget()
+    {
+        if(target && !notified) {
+            notified = true;
+            target->streamReady();
+        }
+    }
+
+    void end(bool successful, const QVariant &result)
+    {
+        QMutexLocker locker(&mutex);
+        if(ended || canceled)
+            return;
+        ended = true;
+        this->successful = successful;
+        this->result = result;
+        notifyTarget();
+    }
+};
+
+class RpcStreamWriterOwner
+{
+public:
+    QSharedPointer<RpcStreamWriterData> d;
+
+    RpcStreamWriterOwner(const QSharedPointer<RpcStreamWriterData> &d) : d(d) {}
+
+    ~RpcStreamWriterOwner()
+    {
+        // the last handle of the command is gone, don't leave the caller waiting
+        d->end(false, QVariant("Command finished without ending its stream"));
+    }
+};
+
+
+RpcStreamWriter::RpcStreamWriter()
+{
+}
+
+RpcStreamWriter RpcStreamWriter::create()
+{
+    RpcStreamWriter writer;
+    writer.d = QSharedPointer<RpcStreamWriterData>(new RpcStreamWriterData);
+    writer.owner = QSharedPointer<RpcStreamWriterOwner>(new RpcStreamWriterOwner(writer.d));
+    return writer;
+}
+
+RpcStreamWriter RpcStreamWriter::observer() const
+{
+    RpcStreamWriter writer;
+    writer.d = d;
+    return writer;
+}
+
+bool RpcStreamWriter::isValid() const
+{
+    return !d.isNull();
+}
+
+void RpcStreamWriter::write(const QVariant &chunk)
+{
+    if(!d)
+        return;
+
+    QMutexLocker locker(&d->mutex);
+    if(d->ended || d->canceled)
+        return;
+    d->chunks.enqueue(chunk);
+    if(d->credits > 0)
+        d->notifyTarget();
+}
+
+void RpcStreamWriter::finish(const QVariant &result)
+{
+    if(d)
+        d->end(true, result);
+}
+
+void RpcStreamWriter::fail(const QString &errorMessage)
+{
+    if(d)
+        d->end(false, QVariant(errorMessage));
+}
+
+bool RpcStreamWriter::isCanceled() const
+{
+    if(!d)
+        return false;
+    QMutexLocker locker(&d->mutex);
+    return d->canceled;
+}
+
+int RpcStreamWriter::pendingChunks() const
+{
+    if(!d)
+        return 0;
+    QMutexLocker locker(&d->mutex);
+    return d->chunks.count();
+}
+
+bool RpcStreamWriter::waitForWritable(int msec)
+{
+    if(!d)
+        return false;
+
+    QMutexLocker locker(&d->mutex);
+    while(!d->isWritable())
+        if(!d->writable.wait(&d->mutex, msec < 0 ? ULONG_MAX : msec))
+            return false;
+    return !d->canceled;
+}
+
+void RpcStreamWriter::setTarget(RpcStreamTarget *target, int credits)
+{
+    if(!d) {
+        delete target;
+        return;
+    }
+
+    QMutexLocker locker(&d->mutex);
+    delete d->target;
+    d->target = target;
+    d->credits = credits;
+    d->notified = false;
+    if((d->credits > 0 && !d->chunks.isEmpty()) || d->ended)
+        d->notifyTarget();
+}
+
+void RpcStreamWriter::addCredits(int credits)
+{
+    if(!d)
+        return;
+
+    QMutexLocker locker(&d->mutex);
+    d->credits += credits;
+    d->writable.wakeAll();
+}
+
+void RpcStreamWriter::cancel()
+{
+    if(!d)
+        return;
+
+    QMutexLocker locker(&d->mutex);
+    d->canceled = true;
+    d->chunks.clear();
+    d->writable.wakeAll();
+}
+
+QVariantList RpcStreamWriter::takeChunks(bool *ended, bool *successful, QVariant *result)
+{
+    *ended = false;
+    if(!d)
+        return QVariantList();
+
+    QMutexLocker locker(&d->mutex);
+    QVariantList taken;
+    while(d->credits > 0 && !d->chunks.isEmpty()) {
+        taken << d->chunks.dequeue();
+        --d->credits;
+    }
+    d->notified = false;
+    d->writable.wakeAll();
+
+    if(d->ended && d->chunks.isEmpty()) {
+        *ended = true;
+        *successful = d->successful;
+        *result = d->result;
+    }
+    return taken;
+}
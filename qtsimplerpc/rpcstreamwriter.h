@@ -0,0 +1,98 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#ifndef RPCSTREAMWRITER_H
+#define RPCSTREAMWRITER_H
+
+#include <qtsimplerpc_global.h>
+
+#include <QVariantList>
+#include <QSharedPointer>
+#include <QMetaType>
+
+class RpcStreamWriterData;
+class RpcStreamWriterOwner;
+
+//! Is told when a stream has chunks or its end ready to be sent
+class RpcStreamTarget
+{
+public:
+    virtual ~RpcStreamTarget() {}
+    //! Called from the writing thread
+    virtual void streamReady() = 0;
+};
+
+//! Lets a command send its result in chunks. A slot taking an
+//! RpcStreamWriter as its last parameter (the remote end doesn't pass it)
+//! writes chunks from any thread and ends the stream with finish() or
+//! fail(). Chunks are sent as the receiver grants credit, so a writer
+//! running in a thread of its own should wait for waitForWritable() to
+//! keep memory bounded. Callers not reading streams get all chunks as one
+//! list when the stream ends. Once the last copy of the handle is gone
+//! without ending the stream, it ends with an error.
+class QTSIMPLERPC_EXPORT RpcStreamWriter
+{
+public:
+    //! Creates a handle which isn't attached to a call
+    RpcStreamWriter();
+    static RpcStreamWriter create();
+
+    bool isValid() const;
+
+    void write(const QVariant &chunk);
+    //! Ends the stream; \arg result is passed to the caller's finished callback
+    void finish(const QVariant &result = QVariant());
+    //! Ends the stream with an error
+    void fail(const QString &errorMessage);
+
+    //! True once the caller has canceled the call or disconnected
+    bool isCanceled() const;
+    //! Chunks written but not sent yet
+    int pendingChunks() const;
+    //! Blocks until the receiver has granted credit for more chunks than are
+    //! pending, the stream has been canceled or \arg msec have passed. Don't
+    //! call this in the thread of the connection.
+    bool waitForWritable(int msec = -1);
+
+    //! Used by the connection: a handle to the same stream which doesn't
+    //! count as a copy, so it doesn't keep the stream from ending
+    RpcStreamWriter observer() const;
+    //! Used by the connection: \arg credits is the number of chunks the
+    //! receiver accepts before granting more. Takes ownership of \arg target.
+    void setTarget(RpcStreamTarget *target, int credits);
+    void addCredits(int credits);
+    void cancel();
+    //! Takes the chunks there is credit for. Once the stream has ended and
+    //! all chunks have been taken, \arg ended is set along with the outcome.
+    QVariantList takeChunks(bool *ended, bool *successful, QVariant *result);
+
+private:
+    QSharedPointer<RpcStreamWriterData> d;
+    //! Shared by the copies handed to the command, not by observers
+    QSharedPointer<RpcStreamWriterOwner> owner;
+};
+
+Q_DECLARE_METATYPE(RpcStreamWriter)
+
+#endif // RPCSTREAMWRITER_H
@@ -0,0 +1,156 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#ifndef RPCTESTUTIL_H
+#define RPCTESTUTIL_H
+
+#include <QObject>
+#include <QCoreApplication>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QElapsedTimer>
+#include <QVariant>
+#include <QtTest>
+
+#include <RpcDeferredReply>
+#include <RpcStreamWriter>
+#include <RpcSharedBuffer>
+
+//! Like QVERIFY, but keeps the event loop running until \arg expr holds,
+//! for at most five seconds
+#define RPC_TRY_VERIFY(expr) \
+    do { \
+        QElapsedTimer rpcTryTimer; \
+        rpcTryTimer.start(); \
+        while(!(expr) && !rpcTryTimer.hasExpired(5000)) \
+            QTest::qWait(10); \
+        QVERIFY(expr); \
+    } while(0)
+
+//! Two connected local sockets, both living in the current thread
+class LocalSocketPair
+{
+public:
+    LocalSocketPair() : second(0) {}
+
+    bool open()
+    {
+        QString name = QString("qtsimplerpc-test-%1-%2")
+                .arg(QCoreApplication::applicationPid()).arg(quintptr(this));
+        QLocalServer::removeServer(name);
+        if(!server.listen(name))
+            return false;
+        first.connectToServer(name);
+        if(!first.waitForConnected(5000) || !server.waitForNewConnection(5000))
+            return false;
+        second = server.nextPendingConnection();
+        return second != 0;
+    }
+
+    QLocalServer server;
+    QLocalSocket first;
+    //! Owned by the server
+    QLocalSocket *second;
+};
+
+//! Reads a line written by a connection, running the event loop meanwhile.
+//! Returns the line without its delimiter, or a null array on timeout.
+inline QByteArray readRawLine(QLocalSocket *socket, int timeout = 5000)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while(!socket->canReadLine() && !timer.hasExpired(timeout))
+        QTest::qWait(10);
+    if(!socket->canReadLine())
+        return QByteArray();
+    return socket->readLine().trimmed();
+}
+
+//! Writes a raw line, as a peer of another version would
+inline void writeRawLine(QLocalSocket *socket, const QByteArray &line)
+{
+    socket->write(line + "\n");
+    socket->flush();
+}
+
+//! Collects the results passed to callbacks
+class CallRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    QVariantList results;
+    QList<int> errorCodes;
+    QVariantList chunks;
+
+public slots:
+    void callFinished(QVariant result, int errorCode)
+    {
+        results << result;
+        errorCodes << errorCode;
+    }
+
+    void chunkReceived(QVariant chunk)
+    {
+        chunks << chunk;
+    }
+};
+
+//! The commands called by the tests
+class TestService : public QObject
+{
+    Q_OBJECT
+
+public:
+    QList<RpcDeferredReply> pendingReplies;
+
+public slots:
+    int add(int a, int b) { return a + b; }
+    QString echo(QString text) { return text; }
+    QString repeat(int size) { return QString(size, QChar('x')); }
+    //! Never answers, unless the test finishes the reply
+    void never(RpcDeferredReply reply) { pendingReplies << reply; }
+
+    //! Streams the numbers up to \arg chunks and ends with their count
+    void count(int chunks, RpcStreamWriter writer)
+    {
+        for(int i = 0; i < chunks; ++i)
+            writer.write(i);
+        writer.finish(chunks);
+    }
+
+    //! Drops the stream without ending it
+    void dropStream(RpcStreamWriter writer) { Q_UNUSED(writer); }
+
+    //! Sums the bytes of a buffer passed by reference
+    int sumShared(RpcSharedBuffer buffer)
+    {
+        int sum = 0;
+        for(int i = 0; i < buffer.size(); ++i)
+            sum += quint8(buffer.constData()[i]);
+        return sum;
+    }
+};
+
+#endif // RPCTESTUTIL_H
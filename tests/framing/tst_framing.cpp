@@ -0,0 +1,145 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include <QtTest>
+#include <QtSimpleRpc>
+
+#include "rpctestutil.h"
+
+class TestFraming : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void binaryFraming_data();
+    void binaryFraming();
+    void refusedFraming();
+    void refusedCodec();
+};
+
+void TestFraming::binaryFraming_data()
+{
+    QTest::addColumn<QByteArray>("codec");
+    QTest::addColumn<QByteArray>("compressor");
+    QTest::newRow("json") << QByteArray("json") << QByteArray("none");
+    QTest::newRow("datastream") << QByteArray("datastream") << QByteArray("none");
+    QTest::newRow("json, zlib") << QByteArray("json") << QByteArray("zlib");
+    QTest::newRow("datastream, zlib") << QByteArray("datastream") << QByteArray("zlib");
+}
+
+void TestFraming::binaryFraming()
+{
+    QFETCH(QByteArray, codec);
+    QFETCH(QByteArray, compressor);
+
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+    // the accepting side has to allow what the caller asks for
+    callee.setBinaryFramingAccepted(true);
+    callee.setCodecAccepted(codec);
+    if(compressor != "none")
+        callee.setCompressionAccepted(compressor);
+    caller.setPeerDevice(&sockets.first);
+    callee.setPeerDevice(sockets.second);
+
+    caller.setBinaryFramingEnabled(true);
+    caller.setCodec(codec);
+    if(compressor != "none")
+        caller.setCompression(compressor, 64);
+    RPC_TRY_VERIFY(caller.isBinaryFramingEnabled() && callee.isBinaryFramingEnabled());
+    RPC_TRY_VERIFY(caller.codec() == codec && callee.codec() == codec);
+    RPC_TRY_VERIFY(caller.compression() == compressor && callee.compression() == compressor);
+
+    int errorCode = -1;
+    QCOMPARE(caller.remoteCall("add", QVariantList() << 40 << 2, &errorCode).toInt(), 42);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+
+    // frames may hold any bytes, including delimiters
+    QString text = QString::fromUtf8("spaces, a\nnewline and \xc3\xa4\xc3\xb6\xc3\xbc");
+    QCOMPARE(caller.remoteCall("echo", QVariantList() << text, &errorCode).toString(), text);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+
+    // large enough to be compressed
+    QString large = text.repeated(1000);
+    QCOMPARE(caller.remoteCall("echo", QVariantList() << large, &errorCode).toString(), large);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+
+    // calls in the other direction use the same framing and codec
+    TestService callerService;
+    caller.bindObjectAllSlotsIncoming(&callerService);
+    QCOMPARE(callee.remoteCall("echo", QVariantList() << text, &errorCode).toString(), text);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+}
+
+void TestFraming::refusedFraming()
+{
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+    caller.setPeerDevice(&sockets.first);
+    callee.setPeerDevice(sockets.second);
+
+    // not accepted by the callee, the caller switches back
+    caller.setBinaryFramingEnabled(true);
+    QTest::qWait(200);
+    QVERIFY(!caller.isBinaryFramingEnabled());
+    QVERIFY(!callee.isBinaryFramingEnabled());
+
+    int errorCode = -1;
+    QCOMPARE(caller.remoteCall("add", QVariantList() << 1 << 2, &errorCode).toInt(), 3);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+}
+
+void TestFraming::refusedCodec()
+{
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+    callee.setBinaryFramingAccepted(true);
+    caller.setPeerDevice(&sockets.first);
+    callee.setPeerDevice(sockets.second);
+
+    // binary framing is accepted, the codec isn't: JSON is used instead
+    caller.setBinaryFramingEnabled(true);
+    caller.setCodec("datastream");
+    RPC_TRY_VERIFY(caller.isBinaryFramingEnabled() && callee.isBinaryFramingEnabled());
+    QTest::qWait(200);
+    QCOMPARE(caller.codec(), QByteArray("json"));
+    QCOMPARE(callee.codec(), QByteArray("json"));
+
+    int errorCode = -1;
+    QCOMPARE(caller.remoteCall("add", QVariantList() << 1 << 2, &errorCode).toInt(), 3);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+}
+
+QTEST_MAIN(TestFraming)
+
+#include "tst_framing.moc"
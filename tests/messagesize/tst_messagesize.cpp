@@ -0,0 +1,144 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include <QtTest>
+#include <QtSimpleRpc>
+
+#include "rpctestutil.h"
+
+#define MAXIMUM_SIZE 1024
+
+class TestMessageSize : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void oversizedCommand_data();
+    void oversizedCommand();
+    void oversizedResponse_data();
+    void oversizedResponse();
+    void largeLineCommand();
+
+private:
+    void addFramingRows();
+    bool connectPeers(LocalSocketPair *sockets, QtSimpleRpc *caller, QtSimpleRpc *callee, bool binary);
+};
+
+void TestMessageSize::addFramingRows()
+{
+    QTest::addColumn<bool>("binary");
+    QTest::newRow("line framing") << false;
+    QTest::newRow("binary framing") << true;
+}
+
+bool TestMessageSize::connectPeers(LocalSocketPair *sockets, QtSimpleRpc *caller, QtSimpleRpc *callee, bool binary)
+{
+    if(!sockets->open())
+        return false;
+    callee->setBinaryFramingAccepted(true);
+    caller->setPeerDevice(&sockets->first);
+    callee->setPeerDevice(sockets->second);
+    if(!binary)
+        return true;
+
+    caller->setBinaryFramingEnabled(true);
+    QElapsedTimer timer;
+    timer.start();
+    while(!(caller->isBinaryFramingEnabled() && callee->isBinaryFramingEnabled()) && !timer.hasExpired(5000))
+        QTest::qWait(10);
+    return callee->isBinaryFramingEnabled();
+}
+
+void TestMessageSize::oversizedCommand_data()
+{
+    addFramingRows();
+}
+
+void TestMessageSize::oversizedCommand()
+{
+    QFETCH(bool, binary);
+
+    LocalSocketPair sockets;
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+    callee.setMaximumMessageSize(MAXIMUM_SIZE);
+    QVERIFY(connectPeers(&sockets, &caller, &callee, binary));
+
+    // dropped without being buffered and answered with an error
+    int errorCode = -1;
+    caller.remoteCall("echo", QVariantList() << QString(4 * MAXIMUM_SIZE, QChar('x')), &errorCode);
+    QCOMPARE(errorCode, int(QtSimpleRpc::MessageTooLargeError));
+
+    // the messages after it are read as usual
+    QCOMPARE(caller.remoteCall("add", QVariantList() << 1 << 2, &errorCode).toInt(), 3);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+    QString text(MAXIMUM_SIZE / 2, QChar('y'));
+    QCOMPARE(caller.remoteCall("echo", QVariantList() << text, &errorCode).toString(), text);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+}
+
+void TestMessageSize::oversizedResponse_data()
+{
+    addFramingRows();
+}
+
+void TestMessageSize::oversizedResponse()
+{
+    QFETCH(bool, binary);
+
+    LocalSocketPair sockets;
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+    caller.setMaximumMessageSize(MAXIMUM_SIZE);
+    QVERIFY(connectPeers(&sockets, &caller, &callee, binary));
+
+    // the call fails instead of waiting forever
+    int errorCode = -1;
+    caller.remoteCall("repeat", QVariantList() << 4 * MAXIMUM_SIZE, &errorCode);
+    QCOMPARE(errorCode, int(QtSimpleRpc::MessageTooLargeError));
+
+    QCOMPARE(caller.remoteCall("add", QVariantList() << 1 << 2, &errorCode).toInt(), 3);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+}
+
+void TestMessageSize::largeLineCommand()
+{
+    LocalSocketPair sockets;
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+    QVERIFY(connectPeers(&sockets, &caller, &callee, false));
+
+    // large commands are decoded while they arrive, the result is the same
+    QString text = QString("0123456789 \"quoted\" \\ ").repeated(20000);
+    int errorCode = -1;
+    QCOMPARE(caller.remoteCall("echo", QVariantList() << text, &errorCode).toString(), text);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+}
+
+QTEST_MAIN(TestMessageSize)
+
+#include "tst_messagesize.moc"
@@ -0,0 +1,184 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include <QtTest>
+#include <QtSimpleRpc>
+#include <RpcSharedMemoryDevice>
+#include <RpcSharedBuffer>
+
+#include "rpctestutil.h"
+
+//! A small ring, so that large messages have to wait for free space
+#define RING_SIZE 4096
+
+class TestSharedMemory : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void calls();
+    void largeMessages();
+    void sharedBuffer();
+    void writeBeforeAttach();
+    void disconnect();
+
+private:
+    LocalSocketPair *sockets;
+    RpcSharedMemoryDevice *creator;
+    RpcSharedMemoryDevice *attacher;
+};
+
+void TestSharedMemory::init()
+{
+    sockets = new LocalSocketPair;
+    QVERIFY(sockets->open());
+    creator = new RpcSharedMemoryDevice;
+    attacher = new RpcSharedMemoryDevice;
+}
+
+void TestSharedMemory::cleanup()
+{
+    delete creator;
+    delete attacher;
+    delete sockets;
+}
+
+void TestSharedMemory::calls()
+{
+    TestService service;
+    QtSimpleRpc caller, callee;
+    caller.bindObjectAllSlotsIncoming(&service);
+    callee.bindObjectAllSlotsIncoming(&service);
+
+    attacher->attach(sockets->second);
+    QVERIFY(creator->create(&sockets->first, RING_SIZE));
+    RPC_TRY_VERIFY(attacher->isAttached());
+    caller.setPeerDevice(creator);
+    callee.setPeerDevice(attacher);
+
+    int errorCode = -1;
+    for(int i = 0; i < 100; ++i)
+        QCOMPARE(caller.remoteCall("add", QVariantList() << i << 1, &errorCode).toInt(), i + 1);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+
+    // both directions
+    QCOMPARE(callee.remoteCall("echo", QVariantList() << QString("back"), &errorCode).toString(), QString("back"));
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+}
+
+void TestSharedMemory::largeMessages()
+{
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+
+    attacher->attach(sockets->second);
+    QVERIFY(creator->create(&sockets->first, RING_SIZE));
+    RPC_TRY_VERIFY(attacher->isAttached());
+    caller.setPeerDevice(creator);
+    callee.setPeerDevice(attacher);
+
+    // many times the ring size in both directions, wrapping around the rings
+    int errorCode = -1;
+    QString large(25 * RING_SIZE, QChar('x'));
+    QCOMPARE(caller.remoteCall("echo", QVariantList() << large, &errorCode).toString(), large);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+    QCOMPARE(caller.remoteCall("repeat", QVariantList() << 25 * RING_SIZE, &errorCode).toString().size(),
+             25 * RING_SIZE);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+    QCOMPARE(caller.remoteCall("add", QVariantList() << 1 << 2, &errorCode).toInt(), 3);
+}
+
+void TestSharedMemory::sharedBuffer()
+{
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+
+    attacher->attach(sockets->second);
+    QVERIFY(creator->create(&sockets->first, RING_SIZE));
+    RPC_TRY_VERIFY(attacher->isAttached());
+    caller.setPeerDevice(creator);
+    callee.setPeerDevice(attacher);
+
+    // larger than the rings, but only the reference goes through them
+    RpcSharedBuffer buffer = RpcSharedBuffer::create(100 * RING_SIZE);
+    QVERIFY(buffer.isValid());
+    int sum = 0;
+    for(int i = 0; i < buffer.size(); ++i)
+    {
+        buffer.data()[i] = char(i % 256);
+        sum += i % 256;
+    }
+    QVERIFY(RpcSharedBuffer::isReference(buffer.reference()));
+
+    int errorCode = -1;
+    QCOMPARE(caller.remoteCall("sumShared", QVariantList() << buffer.reference(), &errorCode).toInt(), sum);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+
+    // anything else isn't taken for a buffer
+    caller.remoteCall("sumShared", QVariantList() << QString("QtSimpleRpc-buffer-x"), &errorCode);
+    QVERIFY(errorCode != int(QtSimpleRpc::NoError));
+}
+
+void TestSharedMemory::writeBeforeAttach()
+{
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+
+    // the attaching side calls before the key has arrived
+    attacher->attach(sockets->second);
+    QVERIFY(!attacher->isAttached());
+    caller.setPeerDevice(attacher);
+
+    QSignalSpy attachedSpy(attacher, SIGNAL(attached()));
+    CallRecorder recorder;
+    caller.remoteCallWithCallback("add", QVariantList() << 20 << 22, &recorder, SLOT(callFinished(QVariant,int)));
+    QVERIFY(creator->create(&sockets->first, RING_SIZE));
+    callee.setPeerDevice(creator);
+
+    RPC_TRY_VERIFY(recorder.errorCodes.count() == 1);
+    QCOMPARE(attachedSpy.count(), 1);
+    QCOMPARE(recorder.errorCodes.first(), int(QtSimpleRpc::NoError));
+    QCOMPARE(recorder.results.first().toInt(), 42);
+}
+
+void TestSharedMemory::disconnect()
+{
+    attacher->attach(sockets->second);
+    QVERIFY(creator->create(&sockets->first, RING_SIZE));
+    RPC_TRY_VERIFY(attacher->isAttached());
+
+    QSignalSpy disconnectedSpy(attacher, SIGNAL(disconnected()));
+    sockets->first.disconnectFromServer();
+    RPC_TRY_VERIFY(disconnectedSpy.count() == 1);
+    QVERIFY(!attacher->isOpen());
+}
+
+QTEST_MAIN(TestSharedMemory)
+
+#include "tst_sharedmemory.moc"
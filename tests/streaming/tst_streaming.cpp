@@ -0,0 +1,165 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include <QtTest>
+#include <QtSimpleRpc>
+
+#include "rpctestutil.h"
+
+class TestStreaming : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void creditWindow();
+    void cancelStream();
+    void streamCall();
+    void collectedStream();
+    void droppedWriter();
+
+private:
+    void expectChunks(QLocalSocket *peer, quint32 requestId, int first, int last);
+};
+
+void TestStreaming::expectChunks(QLocalSocket *peer, quint32 requestId, int first, int last)
+{
+    for(int i = first; i <= last; ++i)
+        QCOMPARE(readRawLine(peer), "+ #" + QByteArray::number(requestId) + " " + QByteArray::number(i));
+}
+
+void TestStreaming::creditWindow()
+{
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    QLocalSocket *peer = sockets.second;
+    TestService service;
+    QtSimpleRpc rpc;
+    rpc.bindObjectAllSlotsIncoming(&service);
+    rpc.setPeerDevice(&sockets.first);
+
+    QCOMPARE(readRawLine(peer), QByteArray("!tagging on"));
+    writeRawLine(peer, "!tagging on");
+    writeRawLine(peer, "#1 ^2 count [10]");
+
+    // only as many chunks as the window allows, although all have been written
+    expectChunks(peer, 1, 0, 1);
+    QVERIFY(readRawLine(peer, 200).isNull());
+
+    writeRawLine(peer, "!credit 1 3");
+    expectChunks(peer, 1, 2, 4);
+    QVERIFY(readRawLine(peer, 200).isNull());
+
+    // the response follows the last chunk
+    writeRawLine(peer, "!credit 1 10");
+    expectChunks(peer, 1, 5, 9);
+    QCOMPARE(readRawLine(peer), QByteArray("0 #1 10"));
+}
+
+void TestStreaming::cancelStream()
+{
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    QLocalSocket *peer = sockets.second;
+    TestService service;
+    QtSimpleRpc rpc;
+    rpc.bindObjectAllSlotsIncoming(&service);
+    rpc.setPeerDevice(&sockets.first);
+
+    QCOMPARE(readRawLine(peer), QByteArray("!tagging on"));
+    writeRawLine(peer, "!tagging on");
+    writeRawLine(peer, "#2 ^1 count [10]");
+    expectChunks(peer, 2, 0, 0);
+
+    // nothing is sent for a canceled stream, even when granted credit
+    writeRawLine(peer, "!cancel 2");
+    writeRawLine(peer, "!credit 2 10");
+    QVERIFY(readRawLine(peer, 200).isNull());
+
+    writeRawLine(peer, "#3 add [1,2]");
+    QCOMPARE(readRawLine(peer), QByteArray("0 #3 3"));
+}
+
+void TestStreaming::streamCall()
+{
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+    caller.setPeerDevice(&sockets.first);
+    callee.setPeerDevice(sockets.second);
+
+    // the caller grants credit as it receives chunks
+    CallRecorder recorder;
+    caller.remoteCallStream("count", QVariantList() << 100, &recorder,
+                            SLOT(chunkReceived(QVariant)), SLOT(callFinished(QVariant,int)), 4);
+    RPC_TRY_VERIFY(recorder.errorCodes.count() == 1);
+    QCOMPARE(recorder.errorCodes.first(), int(QtSimpleRpc::NoError));
+    QCOMPARE(recorder.results.first().toInt(), 100);
+    QCOMPARE(recorder.chunks.count(), 100);
+    for(int i = 0; i < 100; ++i)
+        QCOMPARE(recorder.chunks.at(i).toInt(), i);
+}
+
+void TestStreaming::collectedStream()
+{
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+    caller.setPeerDevice(&sockets.first);
+    callee.setPeerDevice(sockets.second);
+
+    // callers not reading streams get all chunks as one list
+    int errorCode = -1;
+    QVariantList chunks = caller.remoteCall("count", QVariantList() << 5, &errorCode).toList();
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+    QCOMPARE(chunks.count(), 5);
+    for(int i = 0; i < 5; ++i)
+        QCOMPARE(chunks.at(i).toInt(), i);
+}
+
+void TestStreaming::droppedWriter()
+{
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+    caller.setPeerDevice(&sockets.first);
+    callee.setPeerDevice(sockets.second);
+
+    // the stream ends with an error instead of never
+    CallRecorder recorder;
+    caller.remoteCallStream("dropStream", QVariantList(), &recorder,
+                            SLOT(chunkReceived(QVariant)), SLOT(callFinished(QVariant,int)), 4);
+    RPC_TRY_VERIFY(recorder.errorCodes.count() == 1);
+    QCOMPARE(recorder.errorCodes.first(), int(QtSimpleRpc::SystemError));
+    QVERIFY(recorder.chunks.isEmpty());
+}
+
+QTEST_MAIN(TestStreaming)
+
+#include "tst_streaming.moc"
@@ -0,0 +1,187 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include <QtTest>
+#include <QtSimpleRpc>
+
+#include "rpctestutil.h"
+
+// The baseline version of the protocol knows neither request IDs nor
+// control messages; it answers each control message with an untagged
+// parse error. These tests talk to it through a raw socket.
+#define OLD_PEER_ERROR "2 \"Error parsing command: !tagging on\""
+
+class TestTagging : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void callsOldPeer();
+    void answersOldPeer_data();
+    void answersOldPeer();
+    void noNegotiationWithOldPeer();
+    void taggedPeers();
+    void taggedRawPeer();
+};
+
+void TestTagging::callsOldPeer()
+{
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    QLocalSocket *oldPeer = sockets.second;
+    QtSimpleRpc rpc;
+    rpc.setPeerDevice(&sockets.first);
+    QCOMPARE(readRawLine(oldPeer), QByteArray("!tagging on"));
+
+    CallRecorder recorder;
+    rpc.remoteCallWithCallback("add", QVariantList() << 1 << 2, &recorder, SLOT(callFinished(QVariant,int)));
+    rpc.remoteCallWithCallback("add", QVariantList() << 3 << 4, &recorder, SLOT(callFinished(QVariant,int)));
+
+    // sent untagged, as long as the peer hasn't announced request IDs
+    QVERIFY(readRawLine(oldPeer).startsWith("add "));
+    QVERIFY(readRawLine(oldPeer).startsWith("add "));
+
+    // the error about the announcement arrives first, it mustn't resolve a call
+    writeRawLine(oldPeer, OLD_PEER_ERROR);
+    writeRawLine(oldPeer, "0 3");
+    writeRawLine(oldPeer, "0 7");
+    RPC_TRY_VERIFY(recorder.results.count() == 2);
+    QCOMPARE(recorder.errorCodes, QList<int>() << 0 << 0);
+    QCOMPARE(recorder.results.at(0).toInt(), 3);
+    QCOMPARE(recorder.results.at(1).toInt(), 7);
+
+    // later calls stay untagged
+    rpc.remoteCallWithCallback("add", QVariantList() << 5 << 6, &recorder, SLOT(callFinished(QVariant,int)));
+    QVERIFY(readRawLine(oldPeer).startsWith("add "));
+    writeRawLine(oldPeer, "0 11");
+    RPC_TRY_VERIFY(recorder.results.count() == 3);
+    QCOMPARE(recorder.results.at(2).toInt(), 11);
+}
+
+void TestTagging::answersOldPeer_data()
+{
+    QTest::addColumn<bool>("parallel");
+    QTest::newRow("connection thread") << false;
+    QTest::newRow("parallel dispatch") << true;
+}
+
+void TestTagging::answersOldPeer()
+{
+    QFETCH(bool, parallel);
+
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    QLocalSocket *oldPeer = sockets.second;
+    TestService service;
+    QtSimpleRpc rpc;
+    rpc.bindObjectAllSlotsIncoming(&service);
+    rpc.setParallelDispatchEnabled(parallel);
+    rpc.setPeerDevice(&sockets.first);
+
+    QCOMPARE(readRawLine(oldPeer), QByteArray("!tagging on"));
+    writeRawLine(oldPeer, OLD_PEER_ERROR);
+    for(int i = 0; i < 20; ++i)
+        writeRawLine(oldPeer, "add [" + QByteArray::number(i) + ",1000]");
+
+    // answered untagged and in order, even if run in parallel
+    for(int i = 0; i < 20; ++i)
+        QCOMPARE(readRawLine(oldPeer), "0 " + QByteArray::number(i + 1000));
+}
+
+void TestTagging::noNegotiationWithOldPeer()
+{
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    QLocalSocket *oldPeer = sockets.second;
+    QtSimpleRpc rpc;
+    rpc.setPeerDevice(&sockets.first);
+
+    // requests wait for the peer's announcement, which never comes
+    rpc.setBinaryFramingEnabled(true);
+    rpc.setCodec("datastream");
+    QCOMPARE(readRawLine(oldPeer), QByteArray("!tagging on"));
+    writeRawLine(oldPeer, OLD_PEER_ERROR);
+
+    CallRecorder recorder;
+    rpc.remoteCallWithCallback("add", QVariantList() << 1 << 2, &recorder, SLOT(callFinished(QVariant,int)));
+    QVERIFY(readRawLine(oldPeer).startsWith("add "));
+    writeRawLine(oldPeer, "0 3");
+    RPC_TRY_VERIFY(recorder.results.count() == 1);
+    QCOMPARE(recorder.results.at(0).toInt(), 3);
+
+    // nothing else has been sent, and the framing hasn't changed
+    QTest::qWait(100);
+    QVERIFY(oldPeer->bytesAvailable() == 0);
+    QVERIFY(!rpc.isBinaryFramingEnabled());
+    QCOMPARE(rpc.codec(), QByteArray("json"));
+}
+
+void TestTagging::taggedPeers()
+{
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    TestService service;
+    QtSimpleRpc caller, callee;
+    callee.bindObjectAllSlotsIncoming(&service);
+    caller.setPeerDevice(&sockets.first);
+    callee.setPeerDevice(sockets.second);
+
+    int errorCode = -1;
+    QCOMPARE(caller.remoteCall("add", QVariantList() << 1 << 2, &errorCode).toInt(), 3);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+
+    // pipelined calls are answered by request ID
+    CallRecorder recorder;
+    for(int i = 0; i < 10; ++i)
+        caller.remoteCallWithCallback("add", QVariantList() << i << 1, &recorder, SLOT(callFinished(QVariant,int)));
+    RPC_TRY_VERIFY(recorder.results.count() == 10);
+    for(int i = 0; i < 10; ++i) {
+        QCOMPARE(recorder.errorCodes.at(i), int(QtSimpleRpc::NoError));
+        QCOMPARE(recorder.results.at(i).toInt(), i + 1);
+    }
+}
+
+void TestTagging::taggedRawPeer()
+{
+    LocalSocketPair sockets;
+    QVERIFY(sockets.open());
+    QLocalSocket *peer = sockets.second;
+    TestService service;
+    QtSimpleRpc rpc;
+    rpc.bindObjectAllSlotsIncoming(&service);
+    rpc.setPeerDevice(&sockets.first);
+
+    QCOMPARE(readRawLine(peer), QByteArray("!tagging on"));
+    writeRawLine(peer, "!tagging on");
+    writeRawLine(peer, "#5 add [1,2]");
+    QCOMPARE(readRawLine(peer), QByteArray("0 #5 3"));
+
+    // commands without request ID still get untagged answers
+    writeRawLine(peer, "add [3,4]");
+    QCOMPARE(readRawLine(peer), QByteArray("0 7"));
+}
+
+QTEST_MAIN(TestTagging)
+
+#include "tst_tagging.moc"
@@ -0,0 +1,161 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Sebastian Lehmann
+** Contact: contact@l3.ms
+**
+**
+** This file is part of QtSimpleRPC.
+**
+** QtSimpleRPC is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** QtSimpleRPC is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+
+#include <QtTest>
+#include <QtSimpleRpc>
+
+#include "rpctestutil.h"
+
+class TestTimeout : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void timeout();
+    void defaultTimeout();
+    void cancel();
+    void cancelAll();
+    void lateUntaggedResponse();
+
+private:
+    LocalSocketPair *sockets;
+    TestService *service;
+    QtSimpleRpc *caller;
+    QtSimpleRpc *callee;
+};
+
+void TestTimeout::init()
+{
+    sockets = new LocalSocketPair;
+    QVERIFY(sockets->open());
+    service = new TestService;
+    caller = new QtSimpleRpc;
+    callee = new QtSimpleRpc;
+    callee->bindObjectAllSlotsIncoming(service);
+    caller->setPeerDevice(&sockets->first);
+    callee->setPeerDevice(sockets->second);
+}
+
+void TestTimeout::cleanup()
+{
+    delete caller;
+    delete callee;
+    delete service;
+    delete sockets;
+}
+
+void TestTimeout::timeout()
+{
+    QElapsedTimer timer;
+    timer.start();
+    int errorCode = -1;
+    caller->remoteCall("never", QVariantList(), &errorCode, 100);
+    QCOMPARE(errorCode, int(QtSimpleRpc::TimeoutError));
+    QVERIFY(timer.elapsed() >= 90);
+    QVERIFY(timer.elapsed() < 5000);
+
+    // the late answer is ignored and doesn't resolve another call
+    RPC_TRY_VERIFY(service->pendingReplies.count() == 1);
+    service->pendingReplies.first().finish(-1);
+    QCOMPARE(caller->remoteCall("add", QVariantList() << 1 << 2, &errorCode).toInt(), 3);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+}
+
+void TestTimeout::defaultTimeout()
+{
+    caller->setDefaultCallTimeout(100);
+    CallRecorder recorder;
+    caller->remoteCallWithCallback("never", QVariantList(), &recorder, SLOT(callFinished(QVariant,int)));
+    RPC_TRY_VERIFY(recorder.errorCodes.count() == 1);
+    QCOMPARE(recorder.errorCodes.first(), int(QtSimpleRpc::TimeoutError));
+
+    // calls answered in time aren't affected
+    int errorCode = -1;
+    QCOMPARE(caller->remoteCall("add", QVariantList() << 1 << 2, &errorCode).toInt(), 3);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+}
+
+void TestTimeout::cancel()
+{
+    CallRecorder recorder;
+    quint32 requestId = caller->remoteCallWithCallback("never", QVariantList(), &recorder, SLOT(callFinished(QVariant,int)));
+    RPC_TRY_VERIFY(service->pendingReplies.count() == 1);
+
+    caller->cancelCall(requestId);
+    RPC_TRY_VERIFY(recorder.errorCodes.count() == 1);
+    QCOMPARE(recorder.errorCodes.first(), int(QtSimpleRpc::CanceledError));
+
+    // a second cancel and the late answer don't do anything
+    caller->cancelCall(requestId);
+    service->pendingReplies.first().finish(-1);
+    int errorCode = -1;
+    QCOMPARE(caller->remoteCall("add", QVariantList() << 1 << 2, &errorCode).toInt(), 3);
+    QCOMPARE(errorCode, int(QtSimpleRpc::NoError));
+    QCOMPARE(recorder.errorCodes.count(), 1);
+}
+
+void TestTimeout::cancelAll()
+{
+    CallRecorder recorder;
+    for(int i = 0; i < 3; ++i)
+        caller->remoteCallWithCallback("never", QVariantList(), &recorder, SLOT(callFinished(QVariant,int)));
+    caller->cancelAllCalls();
+    RPC_TRY_VERIFY(recorder.errorCodes.count() == 3);
+    QCOMPARE(recorder.errorCodes, QList<int>() << QtSimpleRpc::CanceledError
+             << QtSimpleRpc::CanceledError << QtSimpleRpc::CanceledError);
+}
+
+void TestTimeout::lateUntaggedResponse()
+{
+    // an older peer answers in order, without request IDs
+    LocalSocketPair oldSockets;
+    QVERIFY(oldSockets.open());
+    QLocalSocket *oldPeer = oldSockets.second;
+    QtSimpleRpc rpc;
+    rpc.setPeerDevice(&oldSockets.first);
+    QCOMPARE(readRawLine(oldPeer), QByteArray("!tagging on"));
+    writeRawLine(oldPeer, "2 \"Error parsing command: !tagging on\"");
+
+    CallRecorder recorder;
+    rpc.remoteCallWithCallback("add", QVariantList() << 1 << 2, &recorder, SLOT(callFinished(QVariant,int)), 100);
+    QVERIFY(readRawLine(oldPeer).startsWith("add "));
+    RPC_TRY_VERIFY(recorder.errorCodes.count() == 1);
+    QCOMPARE(recorder.errorCodes.first(), int(QtSimpleRpc::TimeoutError));
+
+    // the answer to the timed out call mustn't be taken for the next one
+    rpc.remoteCallWithCallback("add", QVariantList() << 3 << 4, &recorder, SLOT(callFinished(QVariant,int)));
+    QVERIFY(readRawLine(oldPeer).startsWith("add "));
+    writeRawLine(oldPeer, "0 3");
+    writeRawLine(oldPeer, "0 7");
+    RPC_TRY_VERIFY(recorder.errorCodes.count() == 2);
+    QCOMPARE(recorder.errorCodes.at(1), int(QtSimpleRpc::NoError));
+    QCOMPARE(recorder.results.at(1).toInt(), 7);
+}
+
+QTEST_MAIN(TestTimeout)
+
+#include "tst_timeout.moc"